@@ -13,7 +13,7 @@
 #include "errno.h"
 #include "types.h"
 
-#define NEWFS_MAGIC           0x52415453       /* TODO: Define by yourself */
+#define NEWFS_MAGIC           0x52415454       /* 磁盘格式变了就换一个，旧格式的盘按未初始化处理 */
 #define NEWFS_DEFAULT_PERM    0777   /* 全权限打开 */
 
 /******************************************************************************
@@ -26,7 +26,8 @@
 * SECTION: newfs_utils.c
 *******************************************************************************/
 char* 			   newfs_get_fname(const char* path);
-int 			   newfs_calc_lvl(const char * path);
+void 			   newfs_path_init(struct newfs_path_iter * it, const char * path);
+boolean 		   newfs_path_next(struct newfs_path_iter * it);
 int 			   newfs_driver_read(int offset, uint8_t *out_content, int size);
 int 			   newfs_driver_write(int offset, uint8_t *in_content, int size);
 
@@ -34,19 +35,63 @@ int 			   newfs_driver_write(int offset, uint8_t *in_content, int size);
 int 			   newfs_mount(struct custom_options options);
 int 			   newfs_umount();
 
+struct newfs_dentry* new_dentry(char * fname, NEWFS_FILE_TYPE ftype);
+void 			   newfs_set_dentry_name(struct newfs_dentry * dentry, const char * fname);
+void 			   newfs_free_dentry(struct newfs_dentry * dentry);
 int 			   newfs_alloc_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry);
-//int 			   newfs_drop_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry);
+int 			   newfs_reserve_dentry(struct newfs_inode * inode, const char * fname);
+struct newfs_dentry* newfs_find_dentry(struct newfs_inode * inode, const char * fname);
+struct newfs_dentry* newfs_find_name(struct newfs_inode * inode, const char * name, int len, uint32_t hash);
+struct newfs_dentry* newfs_dir_next(struct newfs_inode * inode, const char * after, boolean incl);
+int 			   newfs_dir_iterate(struct newfs_inode * inode, off_t pos, newfs_dir_emit_t emit, void * ctx);
+int 			   newfs_itable_prefetch(int * inos, int n);
+int 			   newfs_dir_prefetch(struct newfs_inode * inode);
+uint32_t 		   newfs_hash_name(const char * fname);
+int 			   newfs_detach_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry);
+int 			   newfs_drop_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry);
 struct newfs_inode*  newfs_alloc_inode(struct newfs_dentry * dentry);
-struct newfs_inode*  newfs_alloc_data(struct newfs_dentry * dentry);
+int 			   newfs_alloc_data(struct newfs_inode * inode, int blk_cnt);
+int 			   newfs_bmap(struct newfs_inode * inode, int blk, int * run);
 
 int 			   newfs_sync_inode(struct newfs_inode * inode);
-// int 			   newfs_drop_inode(struct newfs_inode * inode);
+int 			   newfs_sync_dirty();
+void 			   newfs_mark_inode_dirty(struct newfs_inode * inode, flag16 flag);
+void 			   newfs_mark_dentry_dirty(struct newfs_dentry * dentry);
+int 			   newfs_free_inode(struct newfs_inode * inode);
+int 			   newfs_drop_inode(struct newfs_inode * inode);
 struct newfs_inode*  newfs_read_inode(struct newfs_dentry * dentry, int ino);
+uint8_t* 		   newfs_get_page(struct newfs_inode * inode, int blk, int need, boolean overwrite);
 struct newfs_dentry* newfs_get_dentry(struct newfs_inode * inode, int dir);
 
 struct newfs_dentry* newfs_lookup(const char * path, boolean * is_find, boolean* is_root);
+void 			   newfs_pcache_drop(const char * path);
+void 			   newfs_pcache_flush();
 
 
+/******************************************************************************
+* SECTION: newfs_bitmap.c
+*******************************************************************************/
+void 			   newfs_bitmap_init(struct newfs_bitmap* bm, uint8_t* map, int nbits);
+void 			   newfs_bitmap_destroy(struct newfs_bitmap* bm);
+int 			   newfs_bitmap_alloc(struct newfs_bitmap* bm, int count);
+int 			   newfs_bitmap_alloc_near(struct newfs_bitmap* bm, int goal, int count);
+void 			   newfs_bitmap_set(struct newfs_bitmap* bm, int start, int count);
+void 			   newfs_bitmap_clear(struct newfs_bitmap* bm, int start, int count);
+int 			   newfs_bitmap_count_free(const struct newfs_bitmap* bm);
+boolean 		   newfs_bitmap_test(const struct newfs_bitmap* bm, int bit);
+
+/******************************************************************************
+* SECTION: newfs_slab.c
+*******************************************************************************/
+void 			   newfs_slab_init(struct newfs_slab* slab, int obj_sz);
+void* 			   newfs_slab_alloc(struct newfs_slab* slab);
+void 			   newfs_slab_free(struct newfs_slab* slab, void* obj);
+void 			   newfs_slab_destroy(struct newfs_slab* slab);
+void 			   newfs_name_init();
+char* 			   newfs_name_alloc(const char* name, int len);
+void 			   newfs_name_free(char* name, int len);
+void 			   newfs_name_destroy();
+
 /******************************************************************************
 * SECTION: newfs.c
 *******************************************************************************/
@@ -67,9 +112,13 @@ int   			   newfs_rmdir(const char *);
 int   			   newfs_rename(const char *, const char *);
 int   			   newfs_utimens(const char *, const struct timespec tv[2]);
 int   			   newfs_truncate(const char *, off_t);
+int   			   newfs_fsync(const char *, int, struct fuse_file_info *);
+int   			   newfs_statfs(const char *, struct statvfs *);
 			
 int   			   newfs_open(const char *, struct fuse_file_info *);
 int   			   newfs_opendir(const char *, struct fuse_file_info *);
+int   			   newfs_releasedir(const char *, struct fuse_file_info *);
+int   			   newfs_ioctl(const char *, int, void *, struct fuse_file_info *, unsigned int, void *);
 
 /******************************************************************************
 * SECTION: newfs_debug.c
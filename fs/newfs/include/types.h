@@ -23,33 +23,66 @@ typedef enum newfs_file_type {
 #define UINT32_BITS             32
 #define UINT8_BITS              8
 
-//#define NEWFS_MAGIC_NUM           0x52415453  newfs.h定义了
+//#define NEWFS_MAGIC_NUM           0x52415454  newfs.h定义了
 #define NEWFS_SUPER_OFS           0
 #define NEWFS_ROOT_INO            0
 
 #define NEWFS_ERROR_NONE          0
 //#define NEWFS_ERROR_ACCESS        EACCES
-//#define NEWFS_ERROR_SEEK          ESPIPE     
-//#define NEWFS_ERROR_ISDIR         EISDIR
+#define NEWFS_ERROR_SEEK          ESPIPE     
+#define NEWFS_ERROR_ISDIR         EISDIR
 #define NEWFS_ERROR_NOSPACE       ENOSPC
 #define NEWFS_ERROR_EXISTS        EEXIST
 #define NEWFS_ERROR_NOTFOUND      ENOENT
 #define NEWFS_ERROR_UNSUPPORTED   ENXIO
 #define NEWFS_ERROR_IO            EIO     /* Error Input/Output */
-//#define NEWFS_ERROR_INVAL         EINVAL  /* Invalid Args */
+#define NEWFS_ERROR_NOTDIR        ENOTDIR
+#define NEWFS_ERROR_NOTEMPTY      ENOTEMPTY
+#define NEWFS_ERROR_FBIG          EFBIG   /* 直接与间接extent都用完，文件无法再增长 */
+#define NEWFS_ERROR_INVAL         EINVAL  /* Invalid Args */
+#define NEWFS_ERROR_NAMETOOLONG   ENAMETOOLONG /* 文件名连同结尾的0超过NEWFS_MAX_FILE_NAME */
 
 #define NEWFS_MAX_FILE_NAME       128
 
-#define NEWFS_INODE_PER_FILE      1
-#define NEWFS_DATA_PER_FILE       6
+#define NEWFS_INODE_SZ            256     /* 磁盘inode槽大小，一个块存放多个inode */
+#define NEWFS_BYTES_PER_INODE     8192    /* 格式化时默认每8KB磁盘空间配一个inode，可用--inode_ratio修改 */
+#define NEWFS_GROUP_META_BLKS     2       /* 每组的inode位图和数据位图各一块 */
+#define NEWFS_EXTENT_CNT          8       /* inode中直接记录的extent数 */
+#define NEWFS_BLOCK_POINTERS      2       /* 间接块指针：一级、二级 */
+#define NEWFS_IND                 0
+#define NEWFS_DIND                1
+#define NEWFS_INLINE_SZ           156     /* 磁盘inode槽尾部可内联存放的文件数据字节数 */
+#define NEWFS_INODE_INDEX         0x1     /* 目录带索引，第0块为根索引块 */
+#define NEWFS_INODE_SORTED        0x2     /* 目录按文件名排序：索引以文件名为键(B+树)，readdir按字典序 */
+#define NEWFS_DX_MAX_LEVELS       2       /* 根索引块之下最多的索引层数 */
+#define NEWFS_PCACHE_SZ           4096    /* 路径缓存槽数，2的幂，按完整路径的散列直接映射 */
+#define NEWFS_NEG_SLOTS           16      /* 每个目录记下的不存在的名字数，2的幂，按散列直接映射 */
+#define NEWFS_BLOOM_MIN           64      /* 目录项少于此数的目录不建Bloom过滤器 */
+#define NEWFS_BLOOM_BITS_PER_NAME 8
+#define NEWFS_BLOOM_K             4       /* 每个名字置位数，8位/名字时误判率约2% */
+#define NEWFS_COOKIE_SEQ_BITS     16      /* readdir续读位置中区分同散列名字的位数 */
+#define NEWFS_PREFETCH_GAP        2       /* 预读时间隔不超过这么多块的inode表块连成一次读 */
+#define NEWFS_PREFETCH_RUN        32      /* 一次预读最多的inode表块数 */
 //#define NEWFS_DEFAULT_PERM        0777  newfs.h定义了
 
-//#define NEWFS_IOC_MAGIC           'S'
+#define NEWFS_IOC_MAGIC           'S'
 //#define NEWFS_IOC_SEEK            _IO(NEWFS_IOC_MAGIC, 0)
+#define NEWFS_IOC_RANGE           _IOWR(NEWFS_IOC_MAGIC, 1, struct newfs_ioc_range)  /* 按前缀列出有序目录中的名字 */
+#define NEWFS_IOC_NAMES_SZ        3832    /* 使struct newfs_ioc_range为4KB */
 
 //#define NEWFS_FLAG_BUF_DIRTY      0x1
 //#define NEWFS_FLAG_BUF_OCCUPY     0x2
 
+#define NEWFS_FLAG_DIRTY          0x1     /* inode头或目录项需要回写 */
+#define NEWFS_FLAG_DATA_DIRTY     0x2     /* 文件数据需要回写 */
+
+#define NEWFS_PAGE_PRESENT        0x1     /* 数据块已在内存中 */
+#define NEWFS_PAGE_DIRTY          0x2     /* 数据块需要回写 */
+#define NEWFS_PAGE_ALIGN          64      /* 文件尾页按该粒度分配，小文件不占满整块 */
+
+#define NEWFS_BITMAP_GROUP_BITS   4096    /* 位图空闲摘要的分组粒度 */
+#define NEWFS_SLAB_CHUNK_SZ       (64 * 1024) /* dentry、inode分配器每次向系统申请的字节数 */
+
 /******************************************************************************
 * SECTION: Macro Function
 *******************************************************************************/
@@ -63,15 +96,47 @@ typedef enum newfs_file_type {
 #define NEWFS_ROUND_UP(value, round)      (value % round == 0 ? value : (value / round + 1) * round)
 
 #define NEWFS_BLKS_SZ(blks)               (blks * NEWFS_BLK_SZ())
-#define NEWFS_ASSIGN_FNAME(pnewfs_dentry, _fname)\ 
-                                        memcpy(pnewfs_dentry->fname, _fname, strlen(_fname))
-
-#define NEWFS_INO_OFS(ino)                (newfs_super.data_offset + ino * NEWFS_BLKS_SZ((\
-                                        NEWFS_INODE_PER_FILE + NEWFS_DATA_PER_FILE)))
-#define NEWFS_DATA_OFS(ino)               (NEWFS_INO_OFS(ino) + NEWFS_BLKS_SZ(NEWFS_INODE_PER_FILE))
+#define NEWFS_NAME_CLASSES                (NEWFS_MAX_FILE_NAME / 8)
+#define NEWFS_NAME_CLASS(len)             ((len) / 8)         /* 连同'\0'按8字节一档 */
+
+#define NEWFS_BLK_CNT(size)               (NEWFS_ROUND_UP((size), NEWFS_BLK_SZ()) / NEWFS_BLK_SZ())
+
+/* 块组：每组位图恰好一个块，inode号和数据块号的高位是组号，低位是组内下标 */
+#define NEWFS_GROUP_BITS()                (NEWFS_BLK_SZ() * UINT8_BITS)
+#define NEWFS_GROUP_OF(no)                ((no) / NEWFS_GROUP_BITS())
+#define NEWFS_GROUP_OFS(no)               (NEWFS_GROUP_OF(no) * NEWFS_BLKS_SZ(newfs_super.group_blks))
+/* 最小的块组：两个位图块、能放下一字节位图（8个）inode的inode表，再加一个数据块 */
+#define NEWFS_GROUP_MIN_BLKS()            (NEWFS_GROUP_META_BLKS + NEWFS_BLK_CNT(UINT8_BITS * NEWFS_INODE_SZ) + 1)
+
+#define NEWFS_INODES_PER_BLK()            (NEWFS_BLK_SZ() / NEWFS_INODE_SZ)
+#define NEWFS_ITABLE_BLKS()               (NEWFS_BLK_CNT((newfs_super.ino_per_group * NEWFS_INODE_SZ)))
+#define NEWFS_ITABLE_IDX(ino)             (NEWFS_GROUP_OF(ino) * NEWFS_ITABLE_BLKS() + \
+                                           ((ino) % NEWFS_GROUP_BITS()) / NEWFS_INODES_PER_BLK())
+#define NEWFS_ITABLE_BLK_OFS(ino)         (newfs_super.inode_offset + NEWFS_GROUP_OFS(ino) + \
+                                           ((ino) % NEWFS_GROUP_BITS()) / NEWFS_INODES_PER_BLK() * NEWFS_BLK_SZ())
+#define NEWFS_INO_OFS(ino)                (NEWFS_ITABLE_BLK_OFS(ino) + (ino) % NEWFS_INODES_PER_BLK() * NEWFS_INODE_SZ)
+#define NEWFS_DATA_BLK_OFS(blkno)         (newfs_super.data_offset + NEWFS_GROUP_OFS(blkno) + \
+                                           ((blkno) % NEWFS_GROUP_BITS()) * NEWFS_BLK_SZ())
+
+#define NEWFS_EXTENTS_PER_BLK()           (NEWFS_BLK_SZ() / sizeof(struct newfs_extent))
+#define NEWFS_PTRS_PER_BLK()              (NEWFS_BLK_SZ() / sizeof(int))
+#define NEWFS_MAX_EXTENTS()               (NEWFS_EXTENT_CNT + NEWFS_EXTENTS_PER_BLK() + \
+                                           NEWFS_PTRS_PER_BLK() * NEWFS_EXTENTS_PER_BLK())
 
 #define NEWFS_IS_DIR(pinode)              (pinode->dentry->ftype == NEWFS_DIR)
 #define NEWFS_IS_REG(pinode)              (pinode->dentry->ftype == NEWFS_REG_FILE)
+#define NEWFS_IS_INLINE(pinode)           (NEWFS_IS_REG(pinode) && (pinode)->blk_cnt == 0)
+#define NEWFS_IS_INLINE_DIR(pinode)       (NEWFS_IS_DIR(pinode) && (pinode)->blk_cnt == 0)
+#define NEWFS_IS_INDEXED(pinode)          ((pinode)->iflags & NEWFS_INODE_INDEX)
+#define NEWFS_IS_SORTED(pinode)           ((pinode)->iflags & NEWFS_INODE_SORTED)
+#define NEWFS_DX_LIMIT()                  ((NEWFS_BLK_SZ() - sizeof(struct newfs_dx_node_d)) / sizeof(struct newfs_dx_entry_d))
+#define NEWFS_BT_KEY_SZ(len)              (NEWFS_ROUND_UP((offsetof(struct newfs_bt_key_d, key) + (len)), sizeof(int)))
+#define NEWFS_BT_CAP()                    (NEWFS_BLK_SZ() - sizeof(struct newfs_bt_node_d))
+#define NEWFS_DENTRY_SZ(len)              (NEWFS_ROUND_UP((sizeof(struct newfs_dentry_d) + (len)), sizeof(int)))
+/* readdir续读位置：高位是名字散列，低NEWFS_COOKIE_SEQ_BITS位是同散列的名字中已读过几个，0表示从头开始 */
+#define NEWFS_COOKIE(hash, seq)           (((off_t)(hash) << NEWFS_COOKIE_SEQ_BITS) | (seq))
+#define NEWFS_COOKIE_HASH(cookie)         ((uint32_t)((cookie) >> NEWFS_COOKIE_SEQ_BITS))
+#define NEWFS_COOKIE_SEQ(cookie)          ((int)((cookie) & ((1 << NEWFS_COOKIE_SEQ_BITS) - 1)))
 //#define NEWFS_IS_SYM_LINK(pinode)         (pinode->dentry->ftype == NEWFS_SYM_LINK)
 
 /******************************************************************************
@@ -81,9 +146,39 @@ struct newfs_dentry;
 struct newfs_inode;
 struct newfs_super;
 
+/* newfs_dir_iterate逐项回调，next是该项之后的续读位置，返回非0时停止 */
+typedef int (*newfs_dir_emit_t)(void* ctx, struct newfs_dentry* dentry, off_t next);
+
+struct newfs_bitmap {
+    uint8_t*           map;                            /* 位图本体，与磁盘格式一致 */
+    int                nbits;                          /* 有效位数 */
+    int                hint;                           /* next-fit游标：下次分配从这里开始找 */
+    int                free;                           /* 空闲位总数 */
+    int                groups;                         /* 摘要组数，每组 NEWFS_BITMAP_GROUP_BITS 位 */
+    int*               group_free;                     /* 每组空闲位数 */
+    uint8_t*           group_full;                     /* 组位图：置位表示该组已满 */
+};
+
+struct newfs_slab {                                    /* 定长对象分配器，见newfs_slab.c */
+    int                obj_sz;
+    int                per_chunk;                      /* 每个大块切出的对象数 */
+    void*              free_list;                      /* 已归还的对象，对象开头存下一个的指针 */
+    uint8_t*           chunk;                          /* 正在切分的大块 */
+    int                chunk_used;
+    void**             chunks;                         /* 全部大块，卸载时一起释放 */
+    int                chunk_cnt;
+    int                chunk_cap;
+    int                live;                           /* 在用的对象数 */
+};
+
 /**********原来就有*************/
 struct custom_options {
 	const char*        device;
+	int                inode_ratio;                    /* 格式化时每个inode对应的磁盘字节数，0取默认值 */
+	int                group_blks;                     /* 格式化时每个块组的块数，0取位图一块能管理的最大值 */
+	int                sorted_dirs;                    /* 新建的目录按文件名排序 */
+	int                dir_bloom;                      /* 为大目录建Bloom过滤器，加速查找不存在的名字 */
+	int                cache_kb;                       /* inode/dentry缓存的内存上限，0表示不限，负数挂载失败 */
 };
 
 struct newfs_super {
@@ -95,8 +190,14 @@ struct newfs_super {
     int                sz_blk;  // 新加的 逻辑块的大小 应该为两倍的IO块大小
     int                sz_usage;
     
-    int                max_ino;
-    int                max_data;
+    int                max_ino;                        /* inode总数 */
+    int                max_data;                       /* 数据块总数 */
+
+    /*块组*/
+    int                group_cnt;
+    int                group_blks;                     /* 每组块数，最后一组可能不满 */
+    int                ino_per_group;
+    int                data_per_group;
     /*inode位图*/
     uint8_t*           map_inode;
     int                map_inode_blks;
@@ -106,15 +207,108 @@ struct newfs_super {
     uint8_t*           map_data;
     int                map_data_blks;
     int                map_data_offset;
+
+    struct newfs_bitmap bmap_inode;                    /* 位图分配器：next-fit游标及按组的空闲摘要 */
+    struct newfs_bitmap bmap_data;
     
-    /*索引节点和数据块的偏移*/
+    /*第0组中各部分的偏移，第g组整体后移 g * group_blks 个块*/
     int                inode_offset;
     int                data_offset;
 
     boolean            is_mounted;
+    boolean            sorted_dirs;                    /* 新建的目录按文件名排序，来自--sorted_dirs */
+    boolean            dir_bloom;                      /* 来自--dir_bloom */
 
     struct newfs_dentry* root_dentry;
 
+    /* 脏数据跟踪：sync/umount 只回写这里记录的修改 */
+    struct newfs_inode*  dirty_inodes;                  /* 脏inode双向链表表头 */
+    boolean*           map_inode_dirty;                /* 按组记录位图块是否需要回写 */
+    boolean*           map_data_dirty;
+
+    /* inode表块缓存：按 NEWFS_ITABLE_IDX 下标，首次访问时整块读入 */
+    uint8_t**          itable;
+    boolean*           itable_dirty;
+    int*               itable_dirty_list;              /* 脏块下标，回写时整块写出 */
+    int                itable_dirty_cnt;
+
+    /* 路径缓存：完整路径命中时不必逐级查找 */
+    struct newfs_pcache_ent* pcache;
+    uint32_t           pcache_gen;                     /* 目录改名时加一，全部缓存项一起失效 */
+
+    /* 内存中的dentry、inode都从这里分配，卸载时整块释放 */
+    struct newfs_slab  dentry_slab;
+    struct newfs_slab  inode_slab;
+    struct newfs_slab  name_slab[NEWFS_NAME_CLASSES];  /* 文件名区，按长度分档 */
+
+    /* inode缓存：占用超过cache_limit时按LRU淘汰，来自--cache_kb */
+    long               cache_limit;                    /* 字节，0表示不限 */
+    long               page_bytes;                     /* 文件页占用的内存 */
+    long               meta_bytes;                     /* 各inode的meta_bytes之和 */
+    struct newfs_inode*  lru_head;                      /* 可淘汰的inode，最近用过的在前 */
+    struct newfs_inode*  lru_tail;
+    uint32_t           lru_tick;                       /* 每次路径查找加一 */
+};
+
+struct newfs_extent {
+    int                start;                          /* 数据区中的起始块号 */
+    int                len;                            /* 连续块数 */
+};
+
+struct newfs_page {
+    uint8_t*           data;                           /* 块数据，首次读写时才从磁盘读入 */
+    int                sz;                             /* data实际分配的字节数，按文件内容增长，不超过一个块 */
+    flag16             flag;                           /* NEWFS_PAGE_PRESENT | NEWFS_PAGE_DIRTY */
+};
+
+struct newfs_dir_blk {
+    int                used;                           /* 块内记录已占用的字节，删除时其后的记录前移 */
+    boolean            dirty;
+    boolean            loaded;                         /* 已读入内存，带索引的目录按需读入 */
+    struct newfs_dentry* dentrys;                      /* 块内的目录项，链在blk_next上 */
+    uint8_t*           dx;                             /* 索引块的内容，叶子块为NULL */
+};
+
+struct newfs_dx_sort {                                 /* 建索引、分裂叶子块时按键排序用 */
+    uint32_t           hash;
+    int                blk;
+    struct newfs_dentry* dentry;
+};
+
+struct newfs_dx_key {                                  /* 索引键：散列索引比较hash，B+树比较name的前len字节 */
+    uint32_t           hash;
+    const char*        name;
+    int                len;
+};
+
+struct newfs_pcache_ent {                              /* 路径缓存项：完整路径 -> dentry */
+    uint32_t           hash;
+    uint32_t           gen;                            /* 与newfs_super.pcache_gen不同即已失效 */
+    char*              path;
+    struct newfs_dentry* dentry;
+};
+
+struct newfs_path_iter {                               /* 路径分量迭代器，不复制也不改动路径，可重入 */
+    const char*        pos;                            /* 下一个分量从这里开始找，指向'\0'时当前分量是最后一级 */
+    const char*        name;                           /* 当前分量，不以'\0'结尾 */
+    int                len;
+    uint32_t           hash;                           /* 当前分量的散列，同newfs_hash_name */
+};
+
+struct newfs_neg_ent {                                 /* 目录中确定不存在的名字 */
+    uint32_t           hash;
+    char               name[NEWFS_MAX_FILE_NAME];      /* 空串表示空槽 */
+};
+
+struct newfs_dir_cursor {                              /* opendir时分配，有序目录readdir给出的每个续读位置都记下对应的名字 */
+    char**             names;                          /* 续读位置k从names[k - 1]之后接着读 */
+    int                cnt;
+    int                cap;
+};
+
+struct newfs_readdir_ctx {                             /* readdir经newfs_dir_iterate把目录项交给filler */
+    void*              buf;
+    fuse_fill_dir_t    filler;
 };
 
 struct newfs_inode {
@@ -125,34 +319,56 @@ struct newfs_inode {
     int                dir_cnt;
     struct newfs_dentry* dentry;                        /* 指向该inode的dentry */
     struct newfs_dentry* dentrys;                       /* 所有目录项 */
-    uint8_t*           data;                           /*指向数据块的指针*/
-    uint8_t *          block_pointer[NEWFS_DATA_PER_FILE];  //指向数据块 块号的指针      
+    struct newfs_dir_blk* dblks;                       /* 目录：每个目录块的占用情况，内联目录为NULL */
+    struct newfs_dentry** dhash;                       /* 目录项按文件名散列的桶，链在hash_next上 */
+    int                dhash_sz;                       /* 桶数，2的幂，目录项多于桶数时翻倍 */
+    int                dhash_cnt;                      /* 已读入内存的目录项数，带索引的目录可能少于dir_cnt */
+    int                iflags;                         /* NEWFS_INODE_INDEX | NEWFS_INODE_SORTED */
+    struct newfs_neg_ent* neg;                         /* 查找未命中的名字，首次未命中时分配 */
+    uint8_t*           bloom;                          /* 目录项名字的Bloom过滤器，--dir_bloom时建立 */
+    int                bloom_bits;                     /* 位数，2的幂 */
+    int                bloom_cnt;                      /* 建立以来记入的名字数 */
+    struct newfs_page* pages;                          /* 按块缓存的文件数据，页表随文件大小增长 */
+    int                page_cnt;                       /* 页表长度 */
+    long               meta_bytes;                     /* 以上目录结构和下面extent映射占用的内存，页另算 */
+
+    struct newfs_extent extents[NEWFS_EXTENT_CNT];     /* 文件块映射：依次覆盖逻辑块 0, 1, 2... */
+    int                extent_cnt;                     /* extent总数，含间接块中的 */
+    int                blk_cnt;                        /* 已分配的数据块数 */
+    int                block_pointer[NEWFS_BLOCK_POINTERS];  /* 一级/二级间接块的数据区块号，-1为未分配 */
+    struct newfs_extent* ind_extents;                  /* 间接块中的extent，按块对齐，首次用到时一次读入 */
+    int*               dind_ptrs;                      /* 二级间接块：其下各extent块的块号 */
+    boolean            ind_loaded;
+    int                ext_dirty;                      /* 最小的被修改extent下标，回写时只写覆盖它之后的间接块 */
+    int                ext_cursor;                     /* bmap游标：上次命中的extent及其起始逻辑块 */
+    int                ext_cursor_blk;
+
+    flag16             flag;                           /* NEWFS_FLAG_DIRTY | NEWFS_FLAG_DATA_DIRTY */
+    struct newfs_inode*  dirty_prev;                    /* 脏链表 */
+    struct newfs_inode*  dirty_next;
+
+    int                cached_cnt;                     /* 在内存中的子inode数，非0时不在LRU链表上 */
+    uint32_t           lru_tick;                       /* 最近一次用到时的lru_tick */
+    struct newfs_inode*  lru_prev;                      /* LRU链表 */
+    struct newfs_inode*  lru_next;
 };
 
 struct newfs_dentry {
-    char     fname[NEWFS_MAX_FILE_NAME];    //name[MAX_NAME_LEN];
-    uint32_t ino;   // 换吗？  int ino;
-    /* TODO: Define yourself */
-    struct newfs_dentry* parent;                        /* 父亲Inode的dentry */
-    struct newfs_dentry* brother;                       /* 兄弟 */
-    
-    struct newfs_inode*  inode;                         /* 指向inode */
+    /* 查找时要碰的字段放在最前，落在同一个缓存行 */
+    uint32_t             hash;                          /* 文件名散列，设置名字时算好 */
+    int                  name_len;
+    struct newfs_dentry* hash_next;                     /* 同一散列桶中的下一个 */
+    char*                fname;                         /* 存在文件名区，以'\0'结尾 */
+    uint32_t             ino;
     NEWFS_FILE_TYPE      ftype;
+    struct newfs_inode*  inode;                         /* 指向inode */
+    struct newfs_dentry* brother;                       /* 兄弟 */
+    struct newfs_dentry* parent;                        /* 父亲Inode的dentry */
+    struct newfs_dentry* blk_next;                      /* 同一目录块中的下一个 */
+    int                  dblk;                          /* 记录所在的父目录块，-1表示未放置或父目录内联 */
+    flag16               flag;                          /* NEWFS_FLAG_DIRTY: 目录项需要回写 */
 };
 
-// 创建目录项
-static inline struct newfs_dentry* new_dentry(char * fname, NEWFS_FILE_TYPE ftype) {
-    struct newfs_dentry * dentry = (struct newfs_dentry *)malloc(sizeof(struct newfs_dentry));
-    memset(dentry, 0, sizeof(struct newfs_dentry));
-    NEWFS_ASSIGN_FNAME(dentry, fname);
-    dentry->ftype   = ftype;
-    dentry->ino     = -1;
-    dentry->inode   = NULL;
-    dentry->parent  = NULL;
-    dentry->brother = NULL; 
-    return dentry;                                           
-}
-
 /******************************************************************************
 * SECTION: FS Specific Structure - Disk structure
 *******************************************************************************/
@@ -173,23 +389,75 @@ struct newfs_super_d
     int                inode_offset;
     int                data_offset;
 
+    int                group_cnt;
+    int                group_blks;
+    int                ino_per_group;
+    int                data_per_group;
 };
 
 struct newfs_inode_d
 {
     int                ino;                           /* 在inode位图中的下标 */
     int                size;                          /* 文件已占用空间 */
-    char               target_path[NEWFS_MAX_FILE_NAME];/* store traget path when it is a symlink */
     int                dir_cnt;
     NEWFS_FILE_TYPE      ftype;   
+    int                extent_cnt;
+    int                blk_cnt;
+    int                iflags;
+    struct newfs_extent extents[NEWFS_EXTENT_CNT];     /* 直接extent */
+    int                block_pointer[NEWFS_BLOCK_POINTERS];  /* 一级间接块存extent，二级间接块存extent块的块号 */
+    union {                                           /* 补齐到NEWFS_INODE_SZ */
+        char           target_path[NEWFS_MAX_FILE_NAME];/* store traget path when it is a symlink */
+        uint8_t        inline_data[NEWFS_INLINE_SZ];  /* 未分配数据块的小文件，内容直接存在这里 */
+    };
 };  
 
-struct newfs_dentry_d
+struct newfs_dentry_d                                 /* 变长目录项，在目录块或内联区中紧凑排列，不跨块 */
 {
-    char               fname[NEWFS_MAX_FILE_NAME];
-    NEWFS_FILE_TYPE      ftype;
+    uint16_t           rec_len;                       /* 整条记录的字节数，0表示本块后面没有记录 */
+    uint8_t            name_len;
+    uint8_t            ftype;
     int                ino;                           /* 指向的ino号 */
+    char               fname[];                       /* 不以'\0'结尾，记录按int对齐 */
 };  
 
+struct newfs_dx_entry_d
+{
+    uint32_t           hash;                          /* 该项覆盖的最小散列值，第0项视作0 */
+    int                blk;                           /* 下一层索引块或叶子块在目录中的块号 */
+};
+
+struct newfs_dx_node_d                                /* 索引块，项按hash升序 */
+{
+    uint16_t           count;
+    uint16_t           levels;                        /* 其下还有几层索引，0表示项指向叶子块 */
+    struct newfs_dx_entry_d entries[];
+};
+
+struct newfs_bt_key_d
+{
+    int                blk;                           /* 名字不小于key的孩子块号 */
+    uint8_t            len;
+    char               key[];                         /* 分隔键，取左右两块之间最短的名字前缀，记录按int对齐 */
+};
+
+struct newfs_bt_node_d                                /* 以文件名为键的索引块，count、levels与newfs_dx_node_d相同 */
+{
+    uint16_t           count;
+    uint16_t           levels;
+    uint16_t           used;                          /* keys已用字节数 */
+    uint16_t           rsv;
+    uint8_t            keys[];                        /* 按名字升序排列的newfs_bt_key_d，第0项的键视作最小 */
+};
+
+struct newfs_ioc_range                                /* NEWFS_IOC_RANGE的参数 */
+{
+    char               prefix[NEWFS_MAX_FILE_NAME];   /* 入：只列出以此开头的名字 */
+    char               after[NEWFS_MAX_FILE_NAME];    /* 入：从大于它的名字开始，空串表示从头；出：本次最后一个名字，续查时原样传回 */
+    int                cnt;                           /* 出：本次返回的名字数 */
+    int                more;                          /* 出：names放不下，还有后续 */
+    char               names[NEWFS_IOC_NAMES_SZ];     /* 出：按字典序排列，以'\0'分隔 */
+};
+
 
 #endif /* _TYPES_H_ */
\ No newline at end of file
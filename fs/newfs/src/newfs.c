@@ -10,6 +10,11 @@
 *******************************************************************************/
 static const struct fuse_opt option_spec[] = {		/* 用于FUSE文件系统解析参数 */
 	OPTION("--device=%s", device),
+	OPTION("--inode_ratio=%d", inode_ratio),
+	OPTION("--group_blks=%d", group_blks),
+	OPTION("--sorted_dirs", sorted_dirs),
+	OPTION("--dir_bloom", dir_bloom),
+	OPTION("--cache_kb=%d", cache_kb),
 	FUSE_OPT_END
 };
 
@@ -25,16 +30,20 @@ static struct fuse_operations operations = {
 	.getattr = newfs_getattr,				 /* 获取文件属性，类似stat，必须完成 */
 	.readdir = newfs_readdir,				 /* 填充dentrys */
 	.mknod = newfs_mknod,					 /* 创建文件，touch相关 */
-	.write = NULL,								  	 /* 写入文件 */
-	.read = NULL,								  	 /* 读文件 */
+	.write = newfs_write,					 /* 写入文件 */
+	.read = newfs_read,						 /* 读文件 */
+	.fsync = newfs_fsync,					 /* 回写脏数据 */
+	.statfs = newfs_statfs,					 /* 文件系统空间统计，df */
 	.utimens = newfs_utimens,				 /* 修改时间，忽略，避免touch报错 */
 	.truncate = NULL,						  		 /* 改变文件大小 */
-	.unlink = NULL,							  		 /* 删除文件 */
-	.rmdir	= NULL,							  		 /* 删除目录， rm -r */
-	.rename = NULL,							  		 /* 重命名，mv */
+	.unlink = newfs_unlink,					 /* 删除文件 */
+	.rmdir	= newfs_rmdir,					 /* 删除目录， rm -r */
+	.rename = newfs_rename,					 /* 重命名，mv */
 
 	.open = NULL,							
-	.opendir = NULL,
+	.opendir = newfs_opendir,				 /* 分配readdir续读游标 */
+	.releasedir = newfs_releasedir,
+	.ioctl = newfs_ioctl,					 /* NEWFS_IOC_RANGE：有序目录按前缀列名 */
 	.access = NULL
 };
 /******************************************************************************
@@ -89,20 +98,43 @@ int newfs_mkdir(const char* path, mode_t mode) {
 	struct newfs_dentry* last_dentry = newfs_lookup(path, &is_find, &is_root);
 	struct newfs_dentry* dentry;
 	struct newfs_inode*  inode;
+	int    ret;
 
 	if (is_find) {
 		return -NEWFS_ERROR_EXISTS;
 	}
+	if (last_dentry == NULL) {						/* 路径上的inode读不进来 */
+		return -NEWFS_ERROR_IO;
+	}
 
 	if (NEWFS_IS_REG(last_dentry->inode)) {
 		return -NEWFS_ERROR_UNSUPPORTED;
 	}
 
 	fname  = newfs_get_fname(path);
+	if (strlen(fname) >= NEWFS_MAX_FILE_NAME) {
+		return -NEWFS_ERROR_NAMETOOLONG;
+	}
+	/* 父目录装不进inode槽或目录项数组增长到下一块时为其分配数据块 */
+	ret = newfs_reserve_dentry(last_dentry->inode, fname);
+	if (ret != NEWFS_ERROR_NONE) {
+		return ret;
+	}
+
 	dentry = new_dentry(fname, NEWFS_DIR); 
 	dentry->parent = last_dentry;
 	inode  = newfs_alloc_inode(dentry);
-	newfs_alloc_dentry(last_dentry->inode, dentry);
+	if (inode == NULL) {
+		newfs_free_dentry(dentry);
+		return -NEWFS_ERROR_NOSPACE;
+	}
+	ret = newfs_alloc_dentry(last_dentry->inode, dentry);
+	if (ret < 0) {									/* 没挂进目录，撤销刚分配的inode */
+		newfs_free_inode(inode);
+		newfs_free_dentry(dentry);
+		return ret;
+	}
+	newfs_mark_dentry_dirty(dentry);
 	printf("newfs_mkdir返回值是  %d\n",NEWFS_ERROR_NONE);
 	return NEWFS_ERROR_NONE;
 }
@@ -126,7 +158,8 @@ int newfs_getattr(const char* path, struct stat * newfs_stat) {
 
 	if (NEWFS_IS_DIR(dentry->inode)) {
 		newfs_stat->st_mode = S_IFDIR | NEWFS_DEFAULT_PERM;
-		newfs_stat->st_size = dentry->inode->dir_cnt * sizeof(struct newfs_dentry_d);
+		newfs_stat->st_size = NEWFS_IS_INLINE_DIR(dentry->inode) ? NEWFS_INLINE_SZ : 
+							  NEWFS_BLKS_SZ(dentry->inode->blk_cnt);
 	}
 	else if (NEWFS_IS_REG(dentry->inode)) {
 		newfs_stat->st_mode = S_IFREG | NEWFS_DEFAULT_PERM;
@@ -153,8 +186,76 @@ int newfs_getattr(const char* path, struct stat * newfs_stat) {
 	return NEWFS_ERROR_NONE;
 }
 
+static int newfs_readdir_emit(void* ctx, struct newfs_dentry* dentry, off_t next) {
+	struct newfs_readdir_ctx* rctx = (struct newfs_readdir_ctx *)ctx;
+	return rctx->filler(rctx->buf, dentry->fname, NULL, next);
+}
+
+/**
+ * @brief 丢掉游标记下的全部续读位置
+ * 
+ * @param cursor 
+ */
+static void newfs_dir_cursor_reset(struct newfs_dir_cursor* cursor) {
+	int i;
+	for (i = 0; i < cursor->cnt; i++) {
+		free(cursor->names[i]);
+	}
+	free(cursor->names);
+	cursor->names = NULL;
+	cursor->cnt   = 0;
+	cursor->cap   = 0;
+}
+
+/**
+ * @brief 有序目录按字典序填充，一次填到buf满为止
+ * 每交出一项，续读位置取游标中的下一个编号并记下该项的名字，之后用这个位置续读（包括seekdir回到
+ * telldir拿到的位置、内核重读没用完的buf）都从那个名字之后接着找，期间增删目录项不会漏也不会重复。
+ * offset为0时从头列，之前的位置作废；没有游标或位置不是它给出的时从头数过offset项
+ * @return int 
+ */
+static int newfs_readdir_sorted(struct newfs_inode* inode, struct newfs_readdir_ctx* ctx, off_t offset,
+								struct fuse_file_info* fi) {
+	struct newfs_dir_cursor* cursor = fi != NULL ? (struct newfs_dir_cursor *)(uintptr_t)fi->fh : NULL;
+	struct newfs_dentry* sub_dentry;
+	char   last[NEWFS_MAX_FILE_NAME] = "";
+	off_t  i, next;
+
+	if (offset == 0 && cursor != NULL) {
+		newfs_dir_cursor_reset(cursor);
+	}
+	else if (offset > 0 && cursor != NULL && offset <= cursor->cnt) {
+		strcpy(last, cursor->names[offset - 1]);
+	}
+	else {
+		for (i = 0; i < offset && (sub_dentry = newfs_dir_next(inode, last, FALSE)) != NULL; i++) {
+			strcpy(last, sub_dentry->fname);
+		}
+	}
+	while ((sub_dentry = newfs_dir_next(inode, last, FALSE)) != NULL) {
+		next = cursor != NULL ? cursor->cnt + 1 : offset + 1;
+		if (newfs_readdir_emit(ctx, sub_dentry, next) != 0) {
+			break;
+		}
+		if (cursor != NULL) {
+			if (cursor->cnt == cursor->cap) {
+				cursor->cap   = cursor->cap == 0 ? 64 : cursor->cap * 2;
+				cursor->names = (char **)realloc(cursor->names, cursor->cap * sizeof(char *));
+			}
+			cursor->names[cursor->cnt] = (char *)malloc(sub_dentry->name_len + 1);
+			strcpy(cursor->names[cursor->cnt++], sub_dentry->fname);
+		}
+		offset = next;
+		strcpy(last, sub_dentry->fname);
+	}
+	return NEWFS_ERROR_NONE;
+}
+
 /**
  * @brief 遍历目录项，填充至buf，并交给FUSE输出
+ * 一次填到buf满为止（filler返回非0），无序目录的offset是newfs_dir_iterate给出的续读位置，
+ * 按散列续读，与目录项在链表中的位置无关，两次调用之间增删目录项也不会错位；
+ * 从头列目录时先批量预读全部目录块和子项的inode表块
  * 
  * @param path 相对于挂载点的路径
  * @param buf 输出buffer
@@ -165,9 +266,9 @@ int newfs_getattr(const char* path, struct stat * newfs_stat) {
  * buf: name会被复制到buf中
  * name: dentry名字
  * stbuf: 文件状态，可忽略
- * off: 下一次offset从哪里开始，这里可以理解为第几个dentry
+ * off: 下一次offset从哪里开始，即该项之后的续读位置
  * 
- * @param offset 第几个目录项？
+ * @param offset 续读位置，0表示从头开始
  * @param fi 可忽略
  * @return int 0成功，否则失败
  */
@@ -175,18 +276,21 @@ int newfs_readdir(const char * path, void * buf, fuse_fill_dir_t filler, off_t o
 			    		 struct fuse_file_info * fi) {
     /* TODO: 解析路径，获取目录的Inode，并读取目录项，利用filler填充到buf，可参考/fs/simplefs/sfs.c的newfs_readdir()函数实现 */
     boolean	is_find, is_root;
-	int		cur_dir = offset;
 
 	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
-	struct newfs_dentry* sub_dentry;
 	struct newfs_inode* inode;
+	struct newfs_readdir_ctx ctx;
 	if (is_find) {
 		inode = dentry->inode;
-		sub_dentry = newfs_get_dentry(inode, cur_dir);
-		if (sub_dentry) {
-			filler(buf, sub_dentry->fname, NULL, ++offset);
+		if (offset == 0) {
+			newfs_dir_prefetch(inode);				/* 只是预读，失败了之后按需读盘 */
 		}
-		return NEWFS_ERROR_NONE;
+		ctx.buf    = buf;
+		ctx.filler = filler;
+		if (NEWFS_IS_SORTED(inode)) {
+			return newfs_readdir_sorted(inode, &ctx, offset, fi);
+		}
+		return newfs_dir_iterate(inode, offset, newfs_readdir_emit, &ctx);
 	}
 	return -NEWFS_ERROR_NOTFOUND;
 }
@@ -207,12 +311,24 @@ int newfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	struct newfs_dentry* dentry;
 	struct newfs_inode* inode;
 	char* fname;
+	int   ret;
 	
 	if (is_find == TRUE) {
 		return -NEWFS_ERROR_EXISTS;
 	}
+	if (last_dentry == NULL) {						/* 路径上的inode读不进来 */
+		return -NEWFS_ERROR_IO;
+	}
 
 	fname = newfs_get_fname(path);
+	if (strlen(fname) >= NEWFS_MAX_FILE_NAME) {
+		return -NEWFS_ERROR_NAMETOOLONG;
+	}
+	/* 父目录装不进inode槽或目录项数组增长到下一块时为其分配数据块 */
+	ret = newfs_reserve_dentry(last_dentry->inode, fname);
+	if (ret != NEWFS_ERROR_NONE) {
+		return ret;
+	}
 	
 	if (S_ISREG(mode)) {
 		dentry = new_dentry(fname, NEWFS_REG_FILE);
@@ -225,7 +341,17 @@ int newfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	}
 	dentry->parent = last_dentry;
 	inode = newfs_alloc_inode(dentry);
-	newfs_alloc_dentry(last_dentry->inode, dentry);
+	if (inode == NULL) {
+		newfs_free_dentry(dentry);
+		return -NEWFS_ERROR_NOSPACE;
+	}
+	ret = newfs_alloc_dentry(last_dentry->inode, dentry);
+	if (ret < 0) {									/* 没挂进目录，撤销刚分配的inode */
+		newfs_free_inode(inode);
+		newfs_free_dentry(dentry);
+		return ret;
+	}
+	newfs_mark_dentry_dirty(dentry);
 	printf("newfs_mknod 返回值是  %d\n",NEWFS_ERROR_NONE);
 
 
@@ -258,7 +384,52 @@ int newfs_utimens(const char* path, const struct timespec tv[2]) {
  */
 int newfs_write(const char* path, const char* buf, size_t size, off_t offset,
 		        struct fuse_file_info* fi) {
-	/* 选做 */
+	boolean	is_find, is_root;
+	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+	struct newfs_inode*  inode;
+	uint8_t* page;
+	int      blk, bias, len, ret;
+	size_t   done = 0;
+	
+	if (is_find == FALSE) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+
+	inode = dentry->inode;
+	
+	if (NEWFS_IS_DIR(inode)) {
+		return -NEWFS_ERROR_ISDIR;	
+	}
+
+	if (inode->size < offset) {
+		return -NEWFS_ERROR_SEEK;
+	}
+
+	/* 先按extent分配新增的数据块，不超过NEWFS_INLINE_SZ的小文件内联在inode中，不分配 */
+	if (offset + size > NEWFS_INLINE_SZ) {
+		ret = newfs_alloc_data(inode, NEWFS_BLK_CNT((offset + size)));
+		if (ret != NEWFS_ERROR_NONE) {
+			return ret;
+		}
+	}
+
+	/* 逐块写入页缓存，只读入被部分覆盖的块 */
+	while (done < size) {
+		blk  = (offset + done) / NEWFS_BLK_SZ();
+		bias = (offset + done) % NEWFS_BLK_SZ();
+		len  = NEWFS_BLK_SZ() - bias < size - done ? NEWFS_BLK_SZ() - bias : size - done;
+		page = newfs_get_page(inode, blk, bias + len, 
+							  bias == 0 && (len == NEWFS_BLK_SZ() || offset + done + len >= inode->size));
+		if (page == NULL) {
+			return -NEWFS_ERROR_IO;
+		}
+		memcpy(page + bias, buf + done, len);
+		inode->pages[blk].flag |= NEWFS_PAGE_DIRTY;
+		done += len;
+	}
+	inode->size = offset + size > inode->size ? offset + size : inode->size;
+	newfs_mark_inode_dirty(inode, NEWFS_FLAG_DIRTY | NEWFS_FLAG_DATA_DIRTY);
+	
 	return size;
 }
 
@@ -274,10 +445,83 @@ int newfs_write(const char* path, const char* buf, size_t size, off_t offset,
  */
 int newfs_read(const char* path, char* buf, size_t size, off_t offset,
 		       struct fuse_file_info* fi) {
-	/* 选做 */
+	boolean	is_find, is_root;
+	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+	struct newfs_inode*  inode;
+	uint8_t* page;
+	int      blk, bias, len;
+	size_t   done = 0;
+
+	if (is_find == FALSE) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+
+	inode = dentry->inode;
+	
+	if (NEWFS_IS_DIR(inode)) {
+		return -NEWFS_ERROR_ISDIR;	
+	}
+
+	if (inode->size <= offset) {
+		return 0;
+	}
+
+	if (offset + size > inode->size) {
+		size = inode->size - offset;
+	}
+
+	/* 逐块从页缓存读出，缺页时才读盘 */
+	while (done < size) {
+		blk  = (offset + done) / NEWFS_BLK_SZ();
+		bias = (offset + done) % NEWFS_BLK_SZ();
+		len  = NEWFS_BLK_SZ() - bias < size - done ? NEWFS_BLK_SZ() - bias : size - done;
+		page = newfs_get_page(inode, blk, bias + len, FALSE);
+		if (page == NULL) {
+			return -NEWFS_ERROR_IO;
+		}
+		memcpy(buf + done, page + bias, len);
+		done += len;
+	}
+
 	return size;			   
 }
 
+/**
+ * @brief 回写文件系统中所有被修改过的inode、目录项和位图
+ * 
+ * @param path 相对于挂载点的路径
+ * @param datasync 可忽略
+ * @param fi 可忽略
+ * @return int 0成功，否则失败
+ */
+int newfs_fsync(const char* path, int datasync, struct fuse_file_info* fi) {
+	(void)path;
+	(void)datasync;
+	return newfs_sync_dirty();
+}
+
+/**
+ * @brief 文件系统空间统计，空闲数直接取自位图摘要，O(1)
+ * 
+ * @param path 可忽略
+ * @param newfs_statvfs 返回统计信息
+ * @return int 0成功，否则失败
+ */
+int newfs_statfs(const char* path, struct statvfs* newfs_statvfs) {
+	(void)path;
+	memset(newfs_statvfs, 0, sizeof(struct statvfs));
+	newfs_statvfs->f_bsize   = NEWFS_BLK_SZ();
+	newfs_statvfs->f_frsize  = NEWFS_BLK_SZ();
+	newfs_statvfs->f_blocks  = newfs_super.max_data;
+	newfs_statvfs->f_bfree   = newfs_bitmap_count_free(&newfs_super.bmap_data);
+	newfs_statvfs->f_bavail  = newfs_statvfs->f_bfree;
+	newfs_statvfs->f_files   = newfs_super.max_ino;
+	newfs_statvfs->f_ffree   = newfs_bitmap_count_free(&newfs_super.bmap_inode);
+	newfs_statvfs->f_favail  = newfs_statvfs->f_ffree;
+	newfs_statvfs->f_namemax = NEWFS_MAX_FILE_NAME - 1;
+	return NEWFS_ERROR_NONE;
+}
+
 /**
  * @brief 删除文件
  * 
@@ -285,8 +529,23 @@ int newfs_read(const char* path, char* buf, size_t size, off_t offset,
  * @return int 0成功，否则失败
  */
 int newfs_unlink(const char* path) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+	int    ret;
+
+	if (is_find == FALSE) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	if (NEWFS_IS_DIR(dentry->inode)) {
+		return -NEWFS_ERROR_ISDIR;
+	}
+	/* 先归还inode和数据块，再从父目录中删去目录项 */
+	newfs_pcache_drop(path);
+	ret = newfs_drop_inode(dentry->inode);
+	if (ret != NEWFS_ERROR_NONE) {
+		return ret;
+	}
+	return newfs_drop_dentry(dentry->parent->inode, dentry);
 }
 
 /**
@@ -302,8 +561,28 @@ int newfs_unlink(const char* path) {
  * @return int 0成功，否则失败
  */
 int newfs_rmdir(const char* path) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+	int    ret;
+
+	if (is_find == FALSE) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	if (is_root) {
+		return -NEWFS_ERROR_UNSUPPORTED;
+	}
+	if (!NEWFS_IS_DIR(dentry->inode)) {
+		return -NEWFS_ERROR_NOTDIR;
+	}
+	if (dentry->inode->dir_cnt > 0) {
+		return -NEWFS_ERROR_NOTEMPTY;
+	}
+	newfs_pcache_drop(path);
+	ret = newfs_drop_inode(dentry->inode);
+	if (ret != NEWFS_ERROR_NONE) {
+		return ret;
+	}
+	return newfs_drop_dentry(dentry->parent->inode, dentry);
 }
 
 /**
@@ -314,8 +593,92 @@ int newfs_rmdir(const char* path) {
  * @return int 0成功，否则失败
  */
 int newfs_rename(const char* from, const char* to) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct newfs_dentry* from_dentry = newfs_lookup(from, &is_find, &is_root);
+	struct newfs_dentry* to_dentry;
+	struct newfs_dentry* to_parent;
+	struct newfs_dentry* dentry_cursor;
+	struct newfs_dentry* from_parent;
+	char*  fname;
+	char   from_name[NEWFS_MAX_FILE_NAME];
+	int    ret;
+
+	if (is_find == FALSE) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	if (is_root) {
+		return -NEWFS_ERROR_UNSUPPORTED;
+	}
+	to_dentry = newfs_lookup(to, &is_find, &is_root);
+	if (to_dentry == NULL) {
+		return -NEWFS_ERROR_IO;
+	}
+	if (is_root) {
+		return -NEWFS_ERROR_UNSUPPORTED;
+	}
+	if (to_dentry == from_dentry) {
+		return NEWFS_ERROR_NONE;
+	}
+	if (is_find) {									/* 目标已存在：文件覆盖文件，目录覆盖空目录 */
+		if (NEWFS_IS_DIR(from_dentry->inode) && !NEWFS_IS_DIR(to_dentry->inode)) {
+			return -NEWFS_ERROR_NOTDIR;
+		}
+		if (!NEWFS_IS_DIR(from_dentry->inode) && NEWFS_IS_DIR(to_dentry->inode)) {
+			return -NEWFS_ERROR_ISDIR;
+		}
+		if (NEWFS_IS_DIR(to_dentry->inode) && to_dentry->inode->dir_cnt > 0) {
+			return -NEWFS_ERROR_NOTEMPTY;
+		}
+		to_parent = to_dentry->parent;
+	}
+	else {
+		to_parent = to_dentry;
+		if (!NEWFS_IS_DIR(to_parent->inode)) {
+			return -NEWFS_ERROR_NOTDIR;
+		}
+	}
+	for (dentry_cursor = to_parent; dentry_cursor != NULL; dentry_cursor = dentry_cursor->parent) {
+		if (dentry_cursor == from_dentry) {			/* 目录不能移到自己下面 */
+			return -NEWFS_ERROR_INVAL;
+		}
+	}
+
+	fname = newfs_get_fname(to);
+	if (strlen(fname) >= NEWFS_MAX_FILE_NAME) {
+		return -NEWFS_ERROR_NAMETOOLONG;
+	}
+	ret   = newfs_reserve_dentry(to_parent->inode, fname);
+	if (ret != NEWFS_ERROR_NONE) {
+		return ret;
+	}
+	if (is_find) {
+		newfs_pcache_drop(to);
+		ret = newfs_drop_inode(to_dentry->inode);
+		if (ret != NEWFS_ERROR_NONE) {
+			return ret;
+		}
+		newfs_drop_dentry(to_parent->inode, to_dentry);
+	}
+
+	/* dentry本身挪到新目录下，inode及其下的目录项都不动 */
+	newfs_pcache_drop(from);
+	if (NEWFS_IS_DIR(from_dentry->inode)) {
+		newfs_pcache_flush();
+	}
+	from_parent = from_dentry->parent;
+	strcpy(from_name, from_dentry->fname);
+	newfs_detach_dentry(from_parent->inode, from_dentry);
+	newfs_set_dentry_name(from_dentry, fname);
+	from_dentry->parent = to_parent;
+	ret = newfs_alloc_dentry(to_parent->inode, from_dentry);
+	if (ret < 0) {									/* 挂不进新目录，放回原处 */
+		newfs_set_dentry_name(from_dentry, from_name);
+		from_dentry->parent = from_parent;
+		newfs_alloc_dentry(from_parent->inode, from_dentry);
+		return ret;
+	}
+	newfs_mark_dentry_dirty(from_dentry);
+	return NEWFS_ERROR_NONE;
 }
 
 /**
@@ -339,8 +702,77 @@ int newfs_open(const char* path, struct fuse_file_info* fi) {
  * @return int 0成功，否则失败
  */
 int newfs_opendir(const char* path, struct fuse_file_info* fi) {
-	/* 选做 */
-	return 0;
+	fi->fh = (uint64_t)(uintptr_t)calloc(1, sizeof(struct newfs_dir_cursor));
+	return fi->fh != 0 ? NEWFS_ERROR_NONE : -ENOMEM;
+}
+
+/**
+ * @brief 关闭目录文件，释放opendir分配的游标
+ * 
+ * @param path 相对于挂载点的路径
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int newfs_releasedir(const char* path, struct fuse_file_info* fi) {
+	newfs_dir_cursor_reset((struct newfs_dir_cursor *)(uintptr_t)fi->fh);
+	free((void *)(uintptr_t)fi->fh);
+	fi->fh = 0;
+	return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 目录ioctl，目前只有NEWFS_IOC_RANGE：按字典序列出有序目录中以prefix开头、大于after的名字
+ * 带索引的有序目录从prefix所在的叶子块读起，只读入结果所在的块，不扫描整个目录
+ * @param path 相对于挂载点的路径
+ * @param cmd 
+ * @param data struct newfs_ioc_range，FUSE已按cmd中的大小拷入拷出
+ * @return int 0成功，否则失败
+ */
+int newfs_ioctl(const char* path, int cmd, void* arg, struct fuse_file_info* fi, 
+				unsigned int flags, void* data) {
+	boolean	is_find, is_root;
+	struct newfs_dentry* dentry;
+	struct newfs_dentry* sub_dentry;
+	struct newfs_ioc_range* range = (struct newfs_ioc_range *)data;
+	int    plen, len, pos = 0;
+	boolean incl;
+
+	if ((unsigned int)cmd != NEWFS_IOC_RANGE) {
+		return -ENOTTY;
+	}
+	dentry = newfs_lookup(path, &is_find, &is_root);
+	if (is_find == FALSE) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	if (!NEWFS_IS_DIR(dentry->inode)) {
+		return -NEWFS_ERROR_NOTDIR;
+	}
+	if (!NEWFS_IS_SORTED(dentry->inode)) {
+		return -NEWFS_ERROR_UNSUPPORTED;
+	}
+	range->prefix[NEWFS_MAX_FILE_NAME - 1] = '\0';
+	range->after[NEWFS_MAX_FILE_NAME - 1]  = '\0';
+	plen = strlen(range->prefix);
+	incl = strcmp(range->after, range->prefix) < 0;	/* after在前缀之前时从prefix本身开始 */
+	if (incl) {
+		strcpy(range->after, range->prefix);
+	}
+	range->cnt  = 0;
+	range->more = FALSE;
+	while ((sub_dentry = newfs_dir_next(dentry->inode, range->after, incl)) != NULL &&
+		   strncmp(sub_dentry->fname, range->prefix, plen) == 0) {
+		len = strlen(sub_dentry->fname) + 1;
+		if (pos + len > NEWFS_IOC_NAMES_SZ) {
+			range->more = TRUE;
+			break;
+		}
+		memcpy(range->names + pos, sub_dentry->fname, len);
+		strcpy(range->after, sub_dentry->fname);
+		pos += len;
+		range->cnt++;
+		incl = FALSE;
+	}
+	return NEWFS_ERROR_NONE;
 }
 
 /**
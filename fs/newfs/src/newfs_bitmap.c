@@ -0,0 +1,384 @@
+#include "newfs.h"
+
+#if defined(__SSE2__) && !defined(NEWFS_NO_SIMD)
+#include <emmintrin.h>
+#define NEWFS_BITMAP_SIMD
+#endif
+
+/**
+ * 位图分配器
+ * 位图按字节存放，第i位位于 map[i / 8] 的第 (i % 8) 位（与原先逐位扫描的约定一致）。
+ * 这里按64位字读取位图，整字已满直接跳过，非满的字用 ctz 找空闲位，
+ * 从而把分配的开销从 O(位数) 降为 O(字数)；支持一次分配N个连续空闲位，
+ * 并保存next-fit游标，下一次从上一次分配的位置之后开始找。
+ * 位图之上再维护一层按组的空闲摘要（见 newfs_bitmap_init），大而满的位图也能直接跳到有空闲的组。
+*/
+
+/**
+ * @brief 读取第w个64位字（小端字节序，低位对应低编号）
+ *
+ * @param map
+ * @param w
+ * @return uint64_t
+ */
+static inline uint64_t newfs_bitmap_word(const uint8_t* map, int w) {
+    uint64_t word;
+    memcpy(&word, map + w * sizeof(uint64_t), sizeof(uint64_t));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+/**
+ * @brief 从第w个字开始跳过全满的字，返回第一个不满的字下标（不超过w_end）
+ * 有SSE2时一次比较16字节
+ * @param map
+ * @param w
+ * @param w_end
+ * @return int
+ */
+static inline int newfs_bitmap_skip_full(const uint8_t* map, int w, int w_end) {
+#ifdef NEWFS_BITMAP_SIMD
+    const __m128i ones = _mm_set1_epi8((char)0xFF);
+    while (w + 2 <= w_end) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(map + w * sizeof(uint64_t)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, ones)) != 0xFFFF) {
+            break;
+        }
+        w += 2;
+    }
+#endif
+    while (w < w_end && newfs_bitmap_word(map, w) == ~(uint64_t)0) {
+        w++;
+    }
+    return w;
+}
+
+/**
+ * @brief 在 [from, to) 内寻找count个连续空闲位
+ *
+ * @param map
+ * @param from
+ * @param to
+ * @param count
+ * @return int 起始位号，找不到返回-1
+ */
+static int newfs_bitmap_find(const uint8_t* map, int from, int to, int count) {
+    int      w, w_end = (to + 63) / 64;
+    int      p, len;
+    int      run = 0, run_start = from;
+    uint64_t word, rest;
+
+    if (from >= to) {
+        return -1;
+    }
+
+    w = from / 64;
+    while (w < w_end) {
+        if (run == 0) {                                /* 不在空闲段内时可以跳过整字已满的区域 */
+            int skipped = newfs_bitmap_skip_full(map, w, w_end);
+            if (skipped != w) {
+                w = skipped;
+                continue;
+            }
+        }
+
+        word = newfs_bitmap_word(map, w);
+        if (w == from / 64 && from % 64 != 0) {        /* from之前的位视为已占用 */
+            word |= (((uint64_t)1 << (from % 64)) - 1);
+        }
+        if (w == w_end - 1 && to % 64 != 0) {          /* to之后的位视为已占用 */
+            word |= ~(((uint64_t)1 << (to % 64)) - 1);
+        }
+
+        if (word == 0) {                               /* 整字空闲 */
+            if (run == 0) {
+                run_start = w * 64;
+            }
+            run += 64;
+            if (run >= count) {
+                return run_start;
+            }
+            w++;
+            continue;
+        }
+
+        p = 0;
+        while (p < 64) {
+            rest = word >> p;
+            if ((rest & 1) == 0) {                     /* 空闲段：数到下一个已占用位 */
+                len = rest == 0 ? 64 - p : __builtin_ctzll(rest);
+                if (run == 0) {
+                    run_start = w * 64 + p;
+                }
+                run += len;
+                if (run >= count) {
+                    return run_start;
+                }
+            }
+            else {                                     /* 已占用段：跳到下一个空闲位 */
+                rest = ~rest;
+                len  = rest == 0 ? 64 - p : __builtin_ctzll(rest);
+                run  = 0;
+            }
+            p += len;
+        }
+        w++;
+    }
+    return -1;
+}
+
+/**
+ * @brief 统计 [0, nbits) 中的空闲位数，按字popcount
+ *
+ * @param map
+ * @param nbits
+ * @return int
+ */
+static int newfs_bitmap_count_range(const uint8_t* map, int nbits) {
+    int      w, used = 0;
+    uint64_t word;
+    for (w = 0; w < nbits / 64; w++) {
+        used += __builtin_popcountll(newfs_bitmap_word(map, w));
+    }
+    if (nbits % 64 != 0) {
+        word  = newfs_bitmap_word(map, w);
+        used += __builtin_popcountll(word & (((uint64_t)1 << (nbits % 64)) - 1));
+    }
+    return nbits - used;
+}
+
+/**
+ * @brief 在 [from, to) 内寻找第一个置位的位
+ *
+ * @param map
+ * @param from
+ * @param to
+ * @return int 位号，找不到返回to
+ */
+static int newfs_bitmap_find_set(const uint8_t* map, int from, int to) {
+    int      w;
+    uint64_t word;
+    for (w = from / 64; w * 64 < to; w++) {
+        word = newfs_bitmap_word(map, w);
+        if (w == from / 64) {
+            word &= ~(((uint64_t)1 << (from % 64)) - 1);
+        }
+        if (word != 0) {
+            w = w * 64 + __builtin_ctzll(word);
+            return w < to ? w : to;
+        }
+    }
+    return to;
+}
+
+/**
+ * @brief 将 [start, start + count) 置位或清零，逐字节用popcount维护摘要中的空闲计数
+ *
+ * @param bm
+ * @param start
+ * @param count
+ * @param is_set
+ */
+static void newfs_bitmap_update(struct newfs_bitmap* bm, int start, int count, boolean is_set) {
+    int     i = start, end = start + count, bits, g;
+    uint8_t mask, old;
+
+    while (i < end) {
+        bits = UINT8_BITS - i % UINT8_BITS;
+        bits = bits < end - i ? bits : end - i;
+        mask = (uint8_t)(((1 << bits) - 1) << (i % UINT8_BITS));
+        old  = bm->map[i / UINT8_BITS];
+        bm->map[i / UINT8_BITS] = is_set ? (old | mask) : (old & ~mask);
+
+        g = i / NEWFS_BITMAP_GROUP_BITS;
+        bm->group_free[g] -= __builtin_popcount(bm->map[i / UINT8_BITS]) - __builtin_popcount(old);
+        bm->free          -= __builtin_popcount(bm->map[i / UINT8_BITS]) - __builtin_popcount(old);
+        if (bm->group_free[g] == 0) {
+            bm->group_full[g / UINT8_BITS] |= (0x1 << (g % UINT8_BITS));
+        }
+        else {
+            bm->group_full[g / UINT8_BITS] &= (uint8_t)(~(0x1 << (g % UINT8_BITS)));
+        }
+        i += bits;
+    }
+}
+
+/**
+ * @brief 建立位图的两级空闲摘要
+ * 位图按 NEWFS_BITMAP_GROUP_BITS 位分组，记录每组空闲位数，
+ * 并用一张组位图标记哪些组已满（清零即该组有空闲），分配时直接跳到有空闲的组
+ * @param bm
+ * @param map 位图本体，字节数至少覆盖 nbits 并按64位字对齐
+ * @param nbits 有效位数
+ */
+void newfs_bitmap_init(struct newfs_bitmap* bm, uint8_t* map, int nbits) {
+    int g, bits;
+
+    bm->map        = map;
+    bm->nbits      = nbits;
+    bm->hint       = 0;
+    bm->free       = 0;
+    bm->groups     = (nbits + NEWFS_BITMAP_GROUP_BITS - 1) / NEWFS_BITMAP_GROUP_BITS;
+    bm->group_free = (int *)calloc(bm->groups, sizeof(int));
+    bm->group_full = (uint8_t *)calloc((bm->groups + 63) / 64, sizeof(uint64_t));
+
+    for (g = 0; g < bm->groups; g++) {
+        bits = nbits - g * NEWFS_BITMAP_GROUP_BITS;
+        bits = bits < NEWFS_BITMAP_GROUP_BITS ? bits : NEWFS_BITMAP_GROUP_BITS;
+        bm->group_free[g] = newfs_bitmap_count_range(map + g * NEWFS_BITMAP_GROUP_BITS / UINT8_BITS, bits);
+        bm->free         += bm->group_free[g];
+        if (bm->group_free[g] == 0) {
+            bm->group_full[g / UINT8_BITS] |= (0x1 << (g % UINT8_BITS));
+        }
+    }
+}
+
+/**
+ * @brief 释放摘要
+ *
+ * @param bm
+ */
+void newfs_bitmap_destroy(struct newfs_bitmap* bm) {
+    free(bm->group_free);
+    free(bm->group_full);
+    bm->group_free = NULL;
+    bm->group_full = NULL;
+}
+
+/**
+ * @brief 在 [from, to) 内分配count个连续空闲位
+ * 先在组位图中找到有空闲的组，连续段不会跨过已满的组，
+ * 因此只需在相邻的非满组构成的区间内逐字扫描
+ * @param bm
+ * @param from
+ * @param to
+ * @param count
+ * @return int
+ */
+static int newfs_bitmap_find_in_groups(struct newfs_bitmap* bm, int from, int to, int count) {
+    int g, g_end, start;
+    int g_to = (to + NEWFS_BITMAP_GROUP_BITS - 1) / NEWFS_BITMAP_GROUP_BITS;
+
+    g = from / NEWFS_BITMAP_GROUP_BITS;
+    while (g < g_to) {
+        g = newfs_bitmap_find(bm->group_full, g, g_to, 1);
+        if (g < 0) {
+            return -1;
+        }
+        g_end = newfs_bitmap_find_set(bm->group_full, g, g_to);
+
+        start = g * NEWFS_BITMAP_GROUP_BITS > from ? g * NEWFS_BITMAP_GROUP_BITS : from;
+        start = newfs_bitmap_find(bm->map, start, 
+                                  g_end * NEWFS_BITMAP_GROUP_BITS < to ? g_end * NEWFS_BITMAP_GROUP_BITS : to, 
+                                  count);
+        if (start >= 0) {
+            return start;
+        }
+        g = g_end;
+    }
+    return -1;
+}
+
+/**
+ * @brief 从from开始向后找count个连续空闲位，找不到再从头找到from处，找到后置位
+ *
+ * @param bm
+ * @param from
+ * @param count
+ * @return int 起始位号，空间不足返回-1
+ */
+static int newfs_bitmap_alloc_from(struct newfs_bitmap* bm, int from, int count) {
+    int start;
+
+    if (count > bm->free) {                            /* 摘要里空闲位不够，直接失败 */
+        return -1;
+    }
+    from = from >= 0 && from < bm->nbits ? from : 0;
+
+    start = newfs_bitmap_find_in_groups(bm, from, bm->nbits, count);
+    if (start < 0 && from > 0) {
+        start = newfs_bitmap_find_in_groups(bm, 0, 
+                    from + count - 1 < bm->nbits ? from + count - 1 : bm->nbits, count);
+    }
+    if (start < 0) {
+        return -1;
+    }
+
+    newfs_bitmap_update(bm, start, count, TRUE);
+    return start;
+}
+
+/**
+ * @brief 分配count个连续空闲位并置位
+ * 从游标开始向后找，找不到再从头找到游标处（next-fit），成功后游标移到分配段之后
+ * @param bm 位图
+ * @param count 连续位数
+ * @return int 起始位号，空间不足返回-1
+ */
+int newfs_bitmap_alloc(struct newfs_bitmap* bm, int count) {
+    int start = newfs_bitmap_alloc_from(bm, bm->hint, count);
+    if (start >= 0) {
+        bm->hint = start + count >= bm->nbits ? 0 : start + count;
+    }
+    return start;
+}
+
+/**
+ * @brief 分配count个连续空闲位并置位，尽量靠近goal
+ * 从goal开始向后找，用于把inode和数据放在期望的块组内；不移动next-fit游标
+ * @param bm 位图
+ * @param goal 期望的起始位号
+ * @param count 连续位数
+ * @return int 起始位号，空间不足返回-1
+ */
+int newfs_bitmap_alloc_near(struct newfs_bitmap* bm, int goal, int count) {
+    return newfs_bitmap_alloc_from(bm, goal, count);
+}
+
+/**
+ * @brief 将 [start, start + count) 置位
+ *
+ * @param bm
+ * @param start
+ * @param count
+ */
+void newfs_bitmap_set(struct newfs_bitmap* bm, int start, int count) {
+    newfs_bitmap_update(bm, start, count, TRUE);
+}
+
+/**
+ * @brief 将 [start, start + count) 清零
+ *
+ * @param bm
+ * @param start
+ * @param count
+ */
+void newfs_bitmap_clear(struct newfs_bitmap* bm, int start, int count) {
+    newfs_bitmap_update(bm, start, count, FALSE);
+}
+
+/**
+ * @brief 空闲位总数，由摘要直接给出，O(1)
+ *
+ * @param bm
+ * @return int
+ */
+int newfs_bitmap_count_free(const struct newfs_bitmap* bm) {
+    return bm->free;
+}
+
+/**
+ * @brief 判断某一位是否已占用，越界视为已占用
+ *
+ * @param bm
+ * @param bit
+ * @return boolean
+ */
+boolean newfs_bitmap_test(const struct newfs_bitmap* bm, int bit) {
+    if (bit < 0 || bit >= bm->nbits) {
+        return TRUE;
+    }
+    return (bm->map[bit / UINT8_BITS] & (0x1 << (bit % UINT8_BITS))) != 0;
+}
@@ -0,0 +1,138 @@
+#include "newfs.h"
+
+extern struct newfs_super newfs_super;
+
+/**
+ * 定长对象分配器
+ * dentry和inode数量多、大小固定，逐个malloc既慢又分散在堆里。
+ * 这里按 NEWFS_SLAB_CHUNK_SZ 字节的大块向系统申请，对象在块内依次切出、连续存放，
+ * 释放的对象串成空闲链表优先复用；卸载时整块一起释放，不用逐个free。
+*/
+
+/**
+ * @brief 初始化分配器，还不申请内存
+ *
+ * @param slab
+ * @param obj_sz 对象大小，至少能放下一个指针
+ */
+void newfs_slab_init(struct newfs_slab* slab, int obj_sz) {
+    obj_sz = NEWFS_ROUND_UP(obj_sz, sizeof(void *));
+    slab->obj_sz     = obj_sz;
+    slab->per_chunk  = NEWFS_SLAB_CHUNK_SZ / obj_sz;
+    slab->free_list  = NULL;
+    slab->chunk      = NULL;
+    slab->chunk_used = slab->per_chunk;
+    slab->chunks     = NULL;
+    slab->chunk_cnt  = 0;
+    slab->chunk_cap  = 0;
+    slab->live       = 0;
+}
+
+/**
+ * @brief 分配一个清零的对象：先从空闲链表取，没有再从当前大块切，当前大块用完时再申请一块
+ *
+ * @param slab
+ * @return void*
+ */
+void* newfs_slab_alloc(struct newfs_slab* slab) {
+    void* obj;
+
+    if (slab->free_list != NULL) {
+        obj             = slab->free_list;
+        slab->free_list = *(void **)obj;
+    }
+    else {
+        if (slab->chunk_used == slab->per_chunk) {
+            if (slab->chunk_cnt == slab->chunk_cap) {
+                slab->chunk_cap = slab->chunk_cap == 0 ? 16 : slab->chunk_cap * 2;
+                slab->chunks    = (void **)realloc(slab->chunks, slab->chunk_cap * sizeof(void *));
+            }
+            slab->chunk = (uint8_t *)malloc(slab->per_chunk * slab->obj_sz);
+            slab->chunks[slab->chunk_cnt++] = slab->chunk;
+            slab->chunk_used = 0;
+        }
+        obj = slab->chunk + slab->chunk_used++ * slab->obj_sz;
+    }
+    memset(obj, 0, slab->obj_sz);
+    slab->live++;
+    return obj;
+}
+
+/**
+ * @brief 归还一个对象，挂到空闲链表上，内存不还给系统
+ *
+ * @param slab
+ * @param obj
+ */
+void newfs_slab_free(struct newfs_slab* slab, void* obj) {
+    if (obj == NULL) {
+        return;
+    }
+    *(void **)obj   = slab->free_list;
+    slab->free_list = obj;
+    slab->live--;
+}
+
+/**
+ * @brief 一次释放全部大块，其中的对象随之全部作废
+ *
+ * @param slab
+ */
+void newfs_slab_destroy(struct newfs_slab* slab) {
+    int i;
+    for (i = 0; i < slab->chunk_cnt; i++) {
+        free(slab->chunks[i]);
+    }
+    free(slab->chunks);
+    newfs_slab_init(slab, slab->obj_sz);
+}
+
+/**
+ * 文件名区
+ * dentry里只留名字指针，名字连同'\0'按8字节一档放进对应档位的分配器，
+ * 短名字不必各占 NEWFS_MAX_FILE_NAME 字节，dentry也因此缩小。
+*/
+
+/**
+ * @brief 初始化各档文件名分配器
+ */
+void newfs_name_init() {
+    int i;
+    for (i = 0; i < NEWFS_NAME_CLASSES; i++) {
+        newfs_slab_init(&newfs_super.name_slab[i], (i + 1) * 8);
+    }
+}
+
+/**
+ * @brief 在文件名区中存一份名字
+ *
+ * @param name 不必以'\0'结尾
+ * @param len 小于 NEWFS_MAX_FILE_NAME
+ * @return char* 以'\0'结尾的副本
+ */
+char* newfs_name_alloc(const char* name, int len) {
+    char* str = (char *)newfs_slab_alloc(&newfs_super.name_slab[NEWFS_NAME_CLASS(len)]);
+    memcpy(str, name, len);
+    str[len] = '\0';
+    return str;
+}
+
+/**
+ * @brief 归还名字，len须与分配时一致
+ *
+ * @param name
+ * @param len
+ */
+void newfs_name_free(char* name, int len) {
+    newfs_slab_free(&newfs_super.name_slab[NEWFS_NAME_CLASS(len)], name);
+}
+
+/**
+ * @brief 释放全部文件名
+ */
+void newfs_name_destroy() {
+    int i;
+    for (i = 0; i < NEWFS_NAME_CLASSES; i++) {
+        newfs_slab_destroy(&newfs_super.name_slab[i]);
+    }
+}
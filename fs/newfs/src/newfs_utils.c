@@ -50,6 +50,8 @@ int newfs_driver_read(int offset, uint8_t *out_content, int size) {
 /**
  * @brief 驱动写
  *  读-修改-写 三个阶段
+ *  只有首尾两个不完整的IO块需要先读出，中间整块直接覆盖；
+ *  offset和size都按IO块对齐时不需要任何读
  * @param offset 
  * @param in_content 
  * @param size 
@@ -59,13 +61,28 @@ int newfs_driver_write(int offset, uint8_t *in_content, int size) {
     int      offset_aligned = NEWFS_ROUND_DOWN(offset, NEWFS_IO_SZ());
     int      bias           = offset - offset_aligned;
     int      size_aligned   = NEWFS_ROUND_UP((size + bias), NEWFS_IO_SZ());
-    uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
-    //先读出需要的磁盘块到内存
-    newfs_driver_read(offset_aligned, temp_content, size_aligned);
-    //然后在内存覆盖指定内容
-    memcpy(temp_content + bias, in_content, size);
+    uint8_t* temp_content;
+    uint8_t* cur;
+
+    if (bias == 0 && size == size_aligned) {           /* 整块写，无需读 */
+        temp_content = in_content;
+    }
+    else {
+        temp_content = (uint8_t*)malloc(size_aligned);
+        //先读出首尾不完整的磁盘块到内存
+        if (bias != 0) {
+            newfs_driver_read(offset_aligned, temp_content, NEWFS_IO_SZ());
+        }
+        if ((size + bias) % NEWFS_IO_SZ() != 0 && 
+            (bias == 0 || size_aligned > NEWFS_IO_SZ())) {
+            newfs_driver_read(offset_aligned + size_aligned - NEWFS_IO_SZ(), 
+                              temp_content + size_aligned - NEWFS_IO_SZ(), NEWFS_IO_SZ());
+        }
+        //然后在内存覆盖指定内容
+        memcpy(temp_content + bias, in_content, size);
+    }
     
+    cur = temp_content;
     ddriver_seek(NEWFS_DRIVER(), offset_aligned, SEEK_SET);
     while (size_aligned != 0)
     {
@@ -75,20 +92,40 @@ int newfs_driver_write(int offset, uint8_t *in_content, int size) {
         size_aligned -= NEWFS_IO_SZ();   
     }
 
-    free(temp_content);
+    if (temp_content != in_content) {
+        free(temp_content);
+    }
     return NEWFS_ERROR_NONE;
 }
 
+/**
+ * @brief 将第g组位图中 [used, NEWFS_GROUP_BITS()) 的位置1
+ * 组内不存在的inode/数据块永久标记为已占用，分配时自然跳过，连续段也不会跨组
+ * @param map 
+ * @param g 
+ * @param used 该组实际拥有的inode/数据块数
+ */
+static void newfs_group_pad(uint8_t* map, int g, int used) {
+    int bit;
+    for (bit = used; bit < NEWFS_GROUP_BITS(); bit++) {
+        map[NEWFS_BLKS_SZ(g) + bit / UINT8_BITS] |= (0x1 << (bit % UINT8_BITS));
+    }
+}
+
 /**
  * @brief 挂载 newfs, Layout 如下
  * 
  * Layout
- * | Super | Inode Map | Data Map | Data |
- *   超级块   索引节点位图  数据块位图 索引节点 数据块
+ * | Super | Group 0 | Group 1 | ... |
+ * 每个块组：
+ * | Inode Map | Data Map | Inode | Data |
+ *   索引节点位图  数据块位图 索引节点 数据块
+ * 各部分大小在第一次挂载（格式化）时由磁盘大小、每inode字节数和块大小算出；
+ * 每组位图各一块，内存中把各组位图首尾相接，当作一张全局位图分配
  * BLK_SZ = IO_SZ * 2   一个逻辑块是两个IO块大小
  * 
  * 挂载本质：初始化管理区缓存
- * 每个Inode占用一个Blk
+ * inode表按 NEWFS_INODE_SZ 紧凑存放，一个块有多个inode
  * @param options 
  * @return int 
  */
@@ -100,24 +137,42 @@ int newfs_mount(struct custom_options options){
     struct newfs_dentry*  root_dentry;
     struct newfs_inode*   root_inode;
 
-    /*索引节点位图*/
-    int                 inode_num;
-    int                 map_inode_blks;
-    
-    /*数据块位图*/
-    int                 data_num;
-    int                 map_data_blks;
+    /*块组*/
+    int                 group_cnt;
+    int                 group_blks;
+    int                 ino_per_group;
+    int                 itable_blks;
+    int                 last_blks;
 
     int                 super_blks;
+    int                 disk_blks;
+    int                 g;
     boolean             is_init = FALSE;
 
+    if (options.cache_kb < 0) {
+        NEWFS_DBG("[%s] invalid cache_kb %d\n", __func__, options.cache_kb);
+        return -NEWFS_ERROR_INVAL;
+    }
     newfs_super.is_mounted = FALSE;
+    newfs_slab_init(&newfs_super.dentry_slab, sizeof(struct newfs_dentry));
+    newfs_slab_init(&newfs_super.inode_slab, sizeof(struct newfs_inode));
+    newfs_name_init();
+    newfs_super.sorted_dirs     = options.sorted_dirs;
+    newfs_super.dir_bloom       = options.dir_bloom;
+    newfs_super.dirty_inodes    = NULL;
+    newfs_super.cache_limit     = (long)options.cache_kb * 1024;
+    newfs_super.page_bytes      = 0;
+    newfs_super.meta_bytes      = 0;
+    newfs_super.lru_head        = NULL;
+    newfs_super.lru_tail        = NULL;
+    newfs_super.lru_tick        = 0;
 
     // 打开驱动
     driver_fd = ddriver_open(options.device);
 
     if (driver_fd < 0) {// 打开驱动失败
-        return driver_fd;
+        ret = driver_fd;
+        goto err_slab;
     }
 
     // 向内存超级块中标记驱动并写入磁盘大小和单次IO大小
@@ -132,59 +187,90 @@ int newfs_mount(struct custom_options options){
 
     if (newfs_driver_read(NEWFS_SUPER_OFS, (uint8_t *)(&newfs_super_d), 
                         sizeof(struct newfs_super_d)) != NEWFS_ERROR_NONE) {
-        return -NEWFS_ERROR_IO;
+        ret = -NEWFS_ERROR_IO;
+        goto err_driver;
     }   
 
     // 根据超级块幻数判断是否为第一次启动磁盘，如果是第一次启动磁盘，则需要建立磁盘超级块的布局。   
     /* 读取super */  /*1. 读入超级块判断是否已初始化*/
     if (newfs_super_d.magic_num != NEWFS_MAGIC) {     /* 第一次挂载  幻数无 */
         /* 估算各部分大小 */  /*//重新估算磁盘布局信息*/
-        //super_blks = NEWFS_ROUND_UP(sizeof(struct newfs_super_d), NEWFS_BLKS_SZ()) / NEWFS_BLKS_SZ();
-        super_blks = 1;
-
-        map_inode_blks = 1;
-        map_data_blks = 1;
-        //int temp_inode_num  = ((NEWFS_DISK_SZ()/NEWFS_BLK_SZ()))/(NEWFS_DATA_PER_FILE + NEWFS_INODE_PER_FILE);
-        // 4MB / 7KB = 585
-        //map_inode_blks = (temp_inode_num / (NEWFS_BLKS_SZ()*8))+1;
-        //map_data_blks = ((NEWFS_DISK_SZ()/NEWFS_BLK_SZ()) / (NEWFS_BLKS_SZ()*8))+1;
-
-        //最多文件数
-        //inode_num  =  NEWFS_DISK_SZ() / ((NEWFS_DATA_PER_FILE + NEWFS_INODE_PER_FILE) * NEWFS_IO_SZ());
-        inode_num  = ((NEWFS_DISK_SZ()/NEWFS_BLK_SZ()) - super_blks - map_data_blks - map_inode_blks)
-        /(NEWFS_DATA_PER_FILE + NEWFS_INODE_PER_FILE);
-        //NEWFS_DATA_PER_FILE 每个文件的数据所占大小6  NEWFS_INODE_PER_FILE 每个文件的索引所占大小1
-        data_num = inode_num*6;
-
-        printf("data_num=%d; inode_num:%d\n",data_num,inode_num);
-
-        /* 布局layout */  // 添加data位图 其余向后延
-        newfs_super.max_ino = inode_num; 
-        newfs_super.max_data = data_num;
-        newfs_super_d.magic_num = NEWFS_MAGIC; //？？？？？????
+        // 块组大小不超过一个位图块能管理的块数；按组大小与每inode字节数确定每组inode数
+        disk_blks  = NEWFS_DISK_SZ() / NEWFS_BLK_SZ();
+        super_blks = NEWFS_BLK_CNT(sizeof(struct newfs_super_d));
+
+        group_blks = options.group_blks > 0 ? options.group_blks : NEWFS_GROUP_BITS();
+        group_blks = group_blks < NEWFS_GROUP_BITS() ? group_blks : NEWFS_GROUP_BITS();
+        group_blks = group_blks < disk_blks - super_blks ? group_blks : disk_blks - super_blks;
+        if (group_blks < NEWFS_GROUP_MIN_BLKS()) {    /* 太小的组连根目录的inode都放不下 */
+            if (disk_blks - super_blks < NEWFS_GROUP_MIN_BLKS()) {
+                NEWFS_DBG("[%s] disk too small\n", __func__);
+                ret = -NEWFS_ERROR_NOSPACE;
+                goto err_driver;
+            }
+            NEWFS_DBG("[%s] group_blks %d raised to %d\n", __func__, group_blks, NEWFS_GROUP_MIN_BLKS());
+            group_blks = NEWFS_GROUP_MIN_BLKS();
+        }
+
+        ino_per_group = NEWFS_BLKS_SZ(group_blks) / 
+                        (options.inode_ratio > 0 ? options.inode_ratio : NEWFS_BYTES_PER_INODE);
+        ino_per_group = NEWFS_ROUND_UP(ino_per_group, UINT8_BITS);
+        ino_per_group = ino_per_group > UINT8_BITS ? ino_per_group : UINT8_BITS;   /* 每组至少一字节位图的inode */
+        ino_per_group = ino_per_group < group_blks / 2 * NEWFS_INODES_PER_BLK() ? 
+                        ino_per_group : group_blks / 2 * NEWFS_INODES_PER_BLK();
+        ino_per_group = ino_per_group < NEWFS_GROUP_BITS() ? ino_per_group : NEWFS_GROUP_BITS();
+        itable_blks   = NEWFS_BLK_CNT((ino_per_group * NEWFS_INODE_SZ));
+
+        // 最后不足一组的部分，放得下位图、inode表和一些数据块才单独成组
+        group_cnt = (disk_blks - super_blks) / group_blks;
+        last_blks = (disk_blks - super_blks) % group_blks;
+        if (last_blks > NEWFS_GROUP_META_BLKS + itable_blks) {
+            group_cnt++;
+        }
+        else {
+            last_blks = group_blks;
+        }
+
+        newfs_super_d.group_cnt      = group_cnt;
+        newfs_super_d.group_blks     = group_blks;
+        newfs_super_d.ino_per_group  = ino_per_group;
+        newfs_super_d.data_per_group = group_blks - NEWFS_GROUP_META_BLKS - itable_blks;
+
+        newfs_super_d.max_ino  = group_cnt * ino_per_group;
+        newfs_super_d.max_data = (group_cnt - 1) * newfs_super_d.data_per_group + 
+                                 last_blks - NEWFS_GROUP_META_BLKS - itable_blks;
+
+        printf("data_num=%d; inode_num:%d\n",newfs_super_d.max_data,newfs_super_d.max_ino);
+
+        /* 布局layout */  // 第0组紧跟超级块，各部分偏移都是第0组内的
+        newfs_super_d.magic_num = NEWFS_MAGIC;
 
         // NEWFS_BLKS_SZ(super_blks) 块的大小*块数
         newfs_super_d.map_inode_offset = NEWFS_SUPER_OFS + NEWFS_BLKS_SZ(super_blks);
-        newfs_super_d.map_data_offset = newfs_super_d.map_inode_offset + NEWFS_BLKS_SZ(map_inode_blks);
+        newfs_super_d.map_data_offset = newfs_super_d.map_inode_offset + NEWFS_BLKS_SZ(1);
 
-        newfs_super_d.inode_offset = newfs_super_d.map_data_offset + NEWFS_BLKS_SZ(map_data_blks);
-        newfs_super_d.data_offset = newfs_super_d.inode_offset + NEWFS_BLKS_SZ(inode_num);
-        // 这里是否有问题           newfs_super_d.data_offset = newfs_super_d.map_inode_offset + NEWFS_BLKS_SZ(inode_num);？？？???
+        newfs_super_d.inode_offset = newfs_super_d.map_data_offset + NEWFS_BLKS_SZ(1);
+        newfs_super_d.data_offset = newfs_super_d.inode_offset + NEWFS_BLKS_SZ(itable_blks);
 
-        newfs_super_d.map_inode_blks  = map_inode_blks;
-        newfs_super_d.map_data_blks  = map_data_blks;
-        newfs_super_d.max_ino = inode_num;
-        newfs_super_d.max_data = data_num;
+        newfs_super_d.map_inode_blks  = group_cnt;
+        newfs_super_d.map_data_blks  = group_cnt;
 
         newfs_super_d.sz_usage    = 0;
 
-        NEWFS_DBG("inode map blocks: %d\n", map_inode_blks);
+        NEWFS_DBG("groups: %d, blocks per group: %d, inodes per group: %d\n", 
+                  group_cnt, group_blks, ino_per_group);
         is_init = TRUE;
     }
      /*2. 生成超级块 内存*/
     //初始化内存中的超级块，和根目录项
     // //超级块未初始化：清零索引节点 数据块位图  or  已初始化：直接读取填充磁盘布局信息
     newfs_super.sz_usage   = newfs_super_d.sz_usage;      /* 建立 in-memory 结构 */
+    newfs_super.max_ino    = newfs_super_d.max_ino;
+    newfs_super.max_data   = newfs_super_d.max_data;
+    newfs_super.group_cnt      = newfs_super_d.group_cnt;
+    newfs_super.group_blks     = newfs_super_d.group_blks;
+    newfs_super.ino_per_group  = newfs_super_d.ino_per_group;
+    newfs_super.data_per_group = newfs_super_d.data_per_group;
     
     /*inode位图 相关 初始化*/
     newfs_super.map_inode = (uint8_t *)malloc(NEWFS_BLKS_SZ(newfs_super_d.map_inode_blks));
@@ -197,18 +283,41 @@ int newfs_mount(struct custom_options options){
     newfs_super.map_data_offset = newfs_super_d.map_data_offset;
     newfs_super.data_offset = newfs_super_d.data_offset;
 
+    newfs_super.map_inode_dirty = (boolean *)calloc(newfs_super.group_cnt, sizeof(boolean));
+    newfs_super.map_data_dirty  = (boolean *)calloc(newfs_super.group_cnt, sizeof(boolean));
+
+    newfs_super.itable            = (uint8_t **)calloc(newfs_super.group_cnt * NEWFS_ITABLE_BLKS(), sizeof(uint8_t *));
+    newfs_super.itable_dirty      = (boolean *)calloc(newfs_super.group_cnt * NEWFS_ITABLE_BLKS(), sizeof(boolean));
+    newfs_super.pcache            = (struct newfs_pcache_ent *)calloc(NEWFS_PCACHE_SZ, sizeof(struct newfs_pcache_ent));
+    newfs_super.pcache_gen        = 1;
+    newfs_super.itable_dirty_list = (int *)malloc(newfs_super.group_cnt * NEWFS_ITABLE_BLKS() * sizeof(int));
+    newfs_super.itable_dirty_cnt  = 0;
+
     /*3. 生成数据块/索引节点位图 内存*/
-    // 读取inode位图   //读取索引节点 数据块位图
-    if (newfs_driver_read(newfs_super_d.map_inode_offset, (uint8_t *)(newfs_super.map_inode), 
-                        NEWFS_BLKS_SZ(newfs_super_d.map_inode_blks)) != NEWFS_ERROR_NONE) {
-        return -NEWFS_ERROR_IO;
+    if (is_init) {                                     /* 新格式化：组内不存在的位置1，所有组的位图都要写出 */
+        memset(newfs_super.map_inode, 0, NEWFS_BLKS_SZ(newfs_super.group_cnt));
+        memset(newfs_super.map_data, 0, NEWFS_BLKS_SZ(newfs_super.group_cnt));
+        for (g = 0; g < newfs_super.group_cnt; g++) {
+            newfs_group_pad(newfs_super.map_inode, g, newfs_super.ino_per_group);
+            newfs_group_pad(newfs_super.map_data, g, g == newfs_super.group_cnt - 1 ? 
+                            newfs_super.max_data - g * newfs_super.data_per_group : newfs_super.data_per_group);
+            newfs_super.map_inode_dirty[g] = TRUE;
+            newfs_super.map_data_dirty[g]  = TRUE;
+        }
     }
-
-    // 读取data数据位图
-    if (newfs_driver_read(newfs_super_d.map_data_offset, (uint8_t *)(newfs_super.map_data), 
-                        NEWFS_BLKS_SZ(newfs_super_d.map_data_blks)) != NEWFS_ERROR_NONE) {
-        return -NEWFS_ERROR_IO;
+    else {                                             /* 逐组读入inode位图和data位图 */
+        for (g = 0; g < newfs_super.group_cnt; g++) {
+            if (newfs_driver_read(newfs_super.map_inode_offset + NEWFS_GROUP_OFS(g * NEWFS_GROUP_BITS()), 
+                                  newfs_super.map_inode + NEWFS_BLKS_SZ(g), NEWFS_BLK_SZ()) != NEWFS_ERROR_NONE ||
+                newfs_driver_read(newfs_super.map_data_offset + NEWFS_GROUP_OFS(g * NEWFS_GROUP_BITS()), 
+                                  newfs_super.map_data + NEWFS_BLKS_SZ(g), NEWFS_BLK_SZ()) != NEWFS_ERROR_NONE) {
+                ret = -NEWFS_ERROR_IO;
+                goto err_maps;
+            }
+        }
     }
+    newfs_bitmap_init(&newfs_super.bmap_inode, newfs_super.map_inode, newfs_super.group_cnt * NEWFS_GROUP_BITS());
+    newfs_bitmap_init(&newfs_super.bmap_data, newfs_super.map_data, newfs_super.group_cnt * NEWFS_GROUP_BITS());
 
     /*4. 初始化根目录的结构，作为后续路径解析入口*/
     //创建空根目录inode及dentry
@@ -218,12 +327,127 @@ int newfs_mount(struct custom_options options){
     }
     //读取根目录inode，生成层级
     root_inode            = newfs_read_inode(root_dentry, NEWFS_ROOT_INO);
+    if (root_inode == NULL) {
+        ret = -NEWFS_ERROR_IO;
+        goto err_bmap;
+    }
     root_dentry->inode    = root_inode;
     newfs_super.root_dentry = root_dentry;
     newfs_super.is_mounted  = TRUE;
 
     newfs_dump_map();//这是干什么的  该有吗？？？？?????
     return ret;
+
+    /* 挂载失败：按建立的相反顺序撤销，根目录项等随分配器一起释放 */
+err_bmap:
+    newfs_bitmap_destroy(&newfs_super.bmap_inode);
+    newfs_bitmap_destroy(&newfs_super.bmap_data);
+err_maps:
+    free(newfs_super.map_inode);
+    free(newfs_super.map_data);
+    free(newfs_super.map_inode_dirty);
+    free(newfs_super.map_data_dirty);
+    for (g = 0; g < newfs_super.group_cnt * NEWFS_ITABLE_BLKS(); g++) {
+        free(newfs_super.itable[g]);
+    }
+    free(newfs_super.itable);
+    free(newfs_super.itable_dirty);
+    free(newfs_super.itable_dirty_list);
+    free(newfs_super.pcache);
+err_driver:
+    ddriver_close(driver_fd);
+err_slab:
+    newfs_slab_destroy(&newfs_super.dentry_slab);
+    newfs_slab_destroy(&newfs_super.inode_slab);
+    newfs_name_destroy();
+    return ret;
+}
+
+/**
+ * inode缓存的LRU链表
+ * 只有不是根、且没有子inode在内存中的inode才挂在链表上，可以被淘汰；
+ * 目录的子inode读入时目录从链表摘下，子inode都被淘汰或删除后再挂回。
+ * 这样目录总比它下面的inode晚淘汰，内存中的dentry的父目录inode一定在内存中。
+*/
+
+/**
+ * @brief 挂到LRU链表头部或尾部
+ * 
+ * @param inode 
+ * @param at_tail 淘汰子inode后父目录挂到尾部，保持原来的先后
+ */
+static void newfs_lru_add(struct newfs_inode* inode, boolean at_tail) {
+    if (inode->dentry->parent == NULL || inode->cached_cnt > 0) {
+        return;
+    }
+    if (at_tail) {
+        inode->lru_next = NULL;
+        inode->lru_prev = newfs_super.lru_tail;
+        if (newfs_super.lru_tail != NULL) {
+            newfs_super.lru_tail->lru_next = inode;
+        }
+        else {
+            newfs_super.lru_head = inode;
+        }
+        newfs_super.lru_tail = inode;
+        return;
+    }
+    inode->lru_tick = newfs_super.lru_tick;
+    inode->lru_prev = NULL;
+    inode->lru_next = newfs_super.lru_head;
+    if (newfs_super.lru_head != NULL) {
+        newfs_super.lru_head->lru_prev = inode;
+    }
+    else {
+        newfs_super.lru_tail = inode;
+    }
+    newfs_super.lru_head = inode;
+}
+
+/**
+ * @brief 从LRU链表摘下，不在链表上时什么也不做
+ * 
+ * @param inode 
+ */
+static void newfs_lru_del(struct newfs_inode* inode) {
+    if (inode->dentry->parent == NULL || inode->cached_cnt > 0) {
+        return;
+    }
+    if (inode->lru_prev != NULL) {
+        inode->lru_prev->lru_next = inode->lru_next;
+    }
+    else {
+        newfs_super.lru_head = inode->lru_next;
+    }
+    if (inode->lru_next != NULL) {
+        inode->lru_next->lru_prev = inode->lru_prev;
+    }
+    else {
+        newfs_super.lru_tail = inode->lru_prev;
+    }
+    inode->lru_prev = NULL;
+    inode->lru_next = NULL;
+}
+
+/**
+ * @brief 目录多了一个在内存中的子inode，第一个时从LRU链表摘下
+ * 
+ * @param inode 父目录inode
+ */
+static void newfs_lru_pin(struct newfs_inode* inode) {
+    newfs_lru_del(inode);
+    inode->cached_cnt++;
+}
+
+/**
+ * @brief 目录少了一个在内存中的子inode，最后一个时挂回LRU链表
+ * 
+ * @param inode 父目录inode
+ * @param at_tail 
+ */
+static void newfs_lru_unpin(struct newfs_inode* inode, boolean at_tail) {
+    inode->cached_cnt--;
+    newfs_lru_add(inode, at_tail);
 }
 
 
@@ -234,48 +458,26 @@ int newfs_mount(struct custom_options options){
  * @return newfs_inode
  */
 struct newfs_inode* newfs_alloc_inode(struct newfs_dentry * dentry) {
-    printf("HAHAHAHHAHAHAH");
     struct newfs_inode* inode;
-    int byte_cursor = 0;    //字节游标，用于遍历位图的字节
-    int bit_cursor  = 0;    //位游标，用于遍历位图的位
-    int ino_cursor  = 0;    //inode游标，表示当前处理的inode块号
-    int dat_cursor  = 0;    //data游标，表示当前处理的data块号
-    int dat_blks_num = 0;// 已找到空闲的data的块数 需满6个
-    int dat_blks[NEWFS_DATA_PER_FILE];// 存放空闲的data块号 需找满6个才能放一个文件  
-
-    boolean is_find_free_entry = FALSE; //是否找到未使用的inode节点
-    boolean is_find_free_entry_enough_data = FALSE; //是否找到足够6个的未使用的data节点
-
-    //​ ①在inode位图上寻找未使用的inode节点。
-    for (byte_cursor = 0; byte_cursor < NEWFS_BLKS_SZ(newfs_super.map_inode_blks); 
-         byte_cursor++)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            if((newfs_super.map_inode[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                /* 当前ino_cursor位置空闲 */
-                newfs_super.map_inode[byte_cursor] |= (0x1 << bit_cursor);
-                is_find_free_entry = TRUE;           
-                break;
-            }
-            ino_cursor++;
-        }
-        if (is_find_free_entry) {
-            break;
-        }
-    }
+    int ino_cursor;         //分配到的inode号
 
-    // ②为目录项分配inode节点并建立他们之间的连接。
-    if (!is_find_free_entry || ino_cursor == newfs_super.max_ino)
-        return -NEWFS_ERROR_NOSPACE;
+    //​ ①在inode位图上按字寻找未使用的inode节点，优先放在父目录所在的块组。
+    ino_cursor = newfs_bitmap_alloc_near(&newfs_super.bmap_inode, 
+                    dentry->parent != NULL ? NEWFS_GROUP_OF(dentry->parent->ino) * NEWFS_GROUP_BITS() : 0, 1);
 
+    // ②为目录项分配inode节点并建立他们之间的连接。
+    if (ino_cursor < 0)
+        return NULL;
 
-    
+    newfs_super.map_inode_dirty[NEWFS_GROUP_OF(ino_cursor)] = TRUE;
 
     // inode data 都有空闲，则分配inode
-    inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
+    inode = (struct newfs_inode*)newfs_slab_alloc(&newfs_super.inode_slab);
     inode->ino  = ino_cursor; 
     inode->size = 0;
-
+    inode->flag = 0;
+    inode->dirty_prev = NULL;
+    inode->dirty_next = NULL;
 
     /* dentry指向/绑定该inode */
     dentry->inode = inode;
@@ -285,331 +487,2578 @@ struct newfs_inode* newfs_alloc_inode(struct newfs_dentry * dentry) {
     
     inode->dir_cnt = 0;
     inode->dentrys = NULL;
-
-
-    // inode指向文件类型需要预分配数据指针 ？？？???
-    if (NEWFS_IS_REG(inode)) {
-        inode->data = (uint8_t *)malloc(NEWFS_BLKS_SZ(NEWFS_DATA_PER_FILE));
-    }
-
+    inode->dblks   = NULL;
+    inode->dhash   = NULL;
+    inode->dhash_sz = 0;
+    inode->dhash_cnt = 0;
+    inode->neg     = NULL;
+    inode->bloom   = NULL;
+    inode->iflags  = NEWFS_IS_DIR(inode) && newfs_super.sorted_dirs ? NEWFS_INODE_SORTED : 0;
+    inode->pages    = NULL;                            /* 空文件不占数据内存 */
+    inode->page_cnt = 0;
+    inode->extent_cnt = 0;                             /* 数据块在写入时才按extent分配 */
+    inode->blk_cnt    = 0;
+    inode->block_pointer[NEWFS_IND]  = -1;
+    inode->block_pointer[NEWFS_DIND] = -1;
+    inode->ind_extents    = NULL;
+    inode->dind_ptrs      = NULL;
+    inode->meta_bytes     = 0;
+    inode->ind_loaded     = TRUE;
+    inode->ext_dirty      = 0;
+    inode->ext_cursor     = 0;
+    inode->ext_cursor_blk = 0;
+
+    newfs_lru_add(inode, FALSE);                      /* 父目录在newfs_alloc_dentry中计数 */
+    /* 新inode尚未落盘 */
+    newfs_mark_inode_dirty(inode, NEWFS_FLAG_DIRTY);
     return inode;
 }
 
 
 
 
-// newfs_read_inode 函数作用是从磁盘中读取inode节点
 /**
- * @brief 
+ * @brief 第i个extent：前 NEWFS_EXTENT_CNT 个在inode中，其余在间接块里
  * 
- * @param dentry dentry指向ino，读取该inode
- * @param ino inode唯一编号
- * @return struct newfs_inode* 
+ * @param inode 
+ * @param i 
+ * @return struct newfs_extent* 
  */
-struct newfs_inode* newfs_read_inode(struct newfs_dentry * dentry, int ino) {
-    struct newfs_inode* inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
-    struct newfs_inode_d inode_d;
-    struct newfs_dentry* sub_dentry;
-    struct newfs_dentry_d dentry_d;
-    int    dir_cnt = 0, i;
-    // ①通过磁盘驱动来将磁盘中ino号的inode读入内存。
-    if (newfs_driver_read(NEWFS_INO_OFS(ino), (uint8_t *)&inode_d, 
-                        sizeof(struct newfs_inode_d)) != NEWFS_ERROR_NONE) {
-        NEWFS_DBG("[%s] io error\n", __func__);
-        return NULL;                    
-    }
-    inode->dir_cnt = 0;
-    inode->ino = inode_d.ino;
-    inode->size = inode_d.size;
-    memcpy(inode->target_path, inode_d.target_path, NEWFS_MAX_FILE_NAME);
-    inode->dentry = dentry;
-    inode->dentrys = NULL;
-    //​ ② 判断inode的文件类型，如果是目录类型则需要读取每一个目录项并建立连接。
-    /*判断iNode节点的文件类型*/
-    if (NEWFS_IS_DIR(inode)) {/*如果是目录的话需要将目录项建立连接*/
-        dir_cnt = inode_d.dir_cnt;
-        for (i = 0; i < dir_cnt; i++)
-        {
-            if (newfs_driver_read(NEWFS_DATA_OFS(ino) + i * sizeof(struct newfs_dentry_d), 
-                                (uint8_t *)&dentry_d, 
-                                sizeof(struct newfs_dentry_d)) != NEWFS_ERROR_NONE) {
-                NEWFS_DBG("[%s] io error\n", __func__);
-                return NULL;                    
-            }
-            sub_dentry = new_dentry(dentry_d.fname, dentry_d.ftype);
-            sub_dentry->parent = inode->dentry;
-            sub_dentry->ino    = dentry_d.ino; 
-            newfs_alloc_dentry(inode, sub_dentry);
-        }
-    }//③如果是文件类型直接读取数据即可。
-    else if (NEWFS_IS_REG(inode)) {
-        inode->data = (uint8_t *)malloc(NEWFS_BLKS_SZ(NEWFS_DATA_PER_FILE));
-        if (newfs_driver_read(NEWFS_DATA_OFS(ino), (uint8_t *)inode->data, 
-                            NEWFS_BLKS_SZ(NEWFS_DATA_PER_FILE)) != NEWFS_ERROR_NONE) {
-            NEWFS_DBG("[%s] io error\n", __func__);
-            return NULL;                    
-        }
-    }
-    return inode;
+static inline struct newfs_extent* newfs_extent_at(struct newfs_inode * inode, int i) {
+    return i < NEWFS_EXTENT_CNT ? &inode->extents[i] : &inode->ind_extents[i - NEWFS_EXTENT_CNT];
 }
 
+/**
+ * @brief 记下inode挂着的目录结构、extent映射增减了多少内存，计入缓存占用
+ * 
+ * @param inode 
+ * @param bytes 
+ */
+static inline void newfs_meta_charge(struct newfs_inode * inode, long bytes) {
+    inode->meta_bytes      += bytes;
+    newfs_super.meta_bytes += bytes;
+}
 
 /**
- * @brief 将内存inode及其下方结构全部刷回磁盘
+ * @brief 第k个extent块的数据区块号：0为一级间接块，之后依次是二级间接块下的各块
  * 
  * @param inode 
+ * @param k 
  * @return int 
  */
-int newfs_sync_inode(struct newfs_inode * inode) {
-    struct newfs_inode_d  inode_d;
-    struct newfs_dentry*  dentry_cursor;
-    struct newfs_dentry_d dentry_d;
-    int ino             = inode->ino;
-    inode_d.ino         = ino;
-    inode_d.size        = inode->size;
-    memcpy(inode_d.target_path, inode->target_path, NEWFS_MAX_FILE_NAME);
-    inode_d.ftype       = inode->dentry->ftype;
-    inode_d.dir_cnt     = inode->dir_cnt;
-    int offset;
-
-    // ①首先将inode写入磁盘
-    if (newfs_driver_write(NEWFS_INO_OFS(ino), (uint8_t *)&inode_d, 
-                     sizeof(struct newfs_inode_d)) != NEWFS_ERROR_NONE) {
-        NEWFS_DBG("[%s] io error\n", __func__);
-        return -NEWFS_ERROR_IO;
-    }
-    //​ ②判断inode文件类型。
-                                                      /* Cycle 1: 写 INODE */
-                                                      /* Cycle 2: 写 数据 */
-    
-    if (NEWFS_IS_DIR(inode)) {
-        //​ ③如果是目录类型则需要首先将目录项写入磁盘，再递归刷写每一个目录项所对应的inode节点。                          
-        dentry_cursor = inode->dentrys;
-        offset        = NEWFS_DATA_OFS(ino);
-        while (dentry_cursor != NULL)
-        {
-            // 写回所有子文件目录项
-            memcpy(dentry_d.fname, dentry_cursor->fname, NEWFS_MAX_FILE_NAME);
-            dentry_d.ftype = dentry_cursor->ftype;
-            dentry_d.ino = dentry_cursor->ino;
-            if (newfs_driver_write(offset, (uint8_t *)&dentry_d, 
-                                 sizeof(struct newfs_dentry_d)) != NEWFS_ERROR_NONE) {
-                NEWFS_DBG("[%s] io error\n", __func__);
-                return -NEWFS_ERROR_IO;                     
-            }
-            // 获取各个目录项的inode 对子inode进行递归调用
-            if (dentry_cursor->inode != NULL) {
-                newfs_sync_inode(dentry_cursor->inode);
-            }
-            //移动dentry_cursor 到其兄弟节点
-            dentry_cursor = dentry_cursor->brother;
-            offset += sizeof(struct newfs_dentry_d);
-        }
-    }
-    else if (NEWFS_IS_REG(inode)) {
-        //④如果是文件类型，则将inode所指向的数据直接写入磁盘。
-        if (newfs_driver_write(NEWFS_DATA_OFS(ino), inode->data, 
-                             NEWFS_BLKS_SZ(NEWFS_DATA_PER_FILE)) != NEWFS_ERROR_NONE) {
-            NEWFS_DBG("[%s] io error\n", __func__);
-            return -NEWFS_ERROR_IO;
-        }
-    }
-    return NEWFS_ERROR_NONE;
+static inline int newfs_extent_blk(struct newfs_inode * inode, int k) {
+    return k == 0 ? inode->block_pointer[NEWFS_IND] : inode->dind_ptrs[k - 1];
 }
 
 /**
- * @brief 
- * 卸载函数
+ * @brief 读入间接块中的extent
+ * 每个间接块只读一次，之后整张映射都在内存中
+ * @param inode 
  * @return int 
  */
-int newfs_umount() {
-    struct newfs_super_d  newfs_super_d; 
+static int newfs_load_extents(struct newfs_inode * inode) {
+    int per = NEWFS_EXTENTS_PER_BLK();
+    int blks, k;
 
-    if (!newfs_super.is_mounted) {
+    if (inode->ind_loaded) {
         return NEWFS_ERROR_NONE;
     }
-    // ①从根节点递归往下刷写根节点。
-    newfs_sync_inode(newfs_super.root_dentry->inode);     /* 从根节点向下刷写节点 */
-
-    // ②将内存超级块转换为磁盘超级块并写入磁盘。                                                
-    newfs_super_d.magic_num           = NEWFS_MAGIC;
-    // 转换inode位图
-    newfs_super_d.map_inode_blks      = newfs_super.map_inode_blks;
-    newfs_super_d.map_inode_offset    = newfs_super.map_inode_offset;
-    //转换data位图
-    newfs_super_d.map_data_blks      = newfs_super.map_data_blks;
-    newfs_super_d.map_data_offset    = newfs_super.map_data_offset;
-    //转换data数据块和inode索引节点
-    newfs_super_d.inode_offset         = newfs_super.inode_offset;
-    newfs_super_d.data_offset         = newfs_super.data_offset;
-
-    newfs_super_d.sz_usage            = newfs_super.sz_usage;
-
-    if (newfs_driver_write(NEWFS_SUPER_OFS, (uint8_t *)&newfs_super_d, 
-                     sizeof(struct newfs_super_d)) != NEWFS_ERROR_NONE) {
-        return -NEWFS_ERROR_IO;
-    }
-
-    // ③将inode位图写入磁盘。
-    if (newfs_driver_write(newfs_super_d.map_inode_offset, (uint8_t *)(newfs_super.map_inode), 
-                         NEWFS_BLKS_SZ(newfs_super_d.map_inode_blks)) != NEWFS_ERROR_NONE) {
-        return -NEWFS_ERROR_IO;
+    blks = (inode->extent_cnt - NEWFS_EXTENT_CNT + per - 1) / per;
+    inode->ind_extents = (struct newfs_extent *)calloc(blks * per, sizeof(struct newfs_extent));
+    newfs_meta_charge(inode, blks * per * sizeof(struct newfs_extent));
+    if (blks > 1) {
+        inode->dind_ptrs = (int *)malloc(NEWFS_PTRS_PER_BLK() * sizeof(int));
+        newfs_meta_charge(inode, NEWFS_PTRS_PER_BLK() * sizeof(int));
+        if (newfs_driver_read(NEWFS_DATA_BLK_OFS(inode->block_pointer[NEWFS_DIND]), 
+                              (uint8_t *)inode->dind_ptrs, NEWFS_BLK_SZ()) != NEWFS_ERROR_NONE) {
+            goto err;
+        }
+        for (k = blks - 1; k < NEWFS_PTRS_PER_BLK(); k++) {   /* 其后的槽未分配 */
+            inode->dind_ptrs[k] = -1;
+        }
     }
-
-    free(newfs_super.map_inode);
-
-    // ③将data位图写入磁盘。
-    if (newfs_driver_write(newfs_super_d.map_data_offset, (uint8_t *)(newfs_super.map_data), 
-                         NEWFS_BLKS_SZ(newfs_super_d.map_data_blks)) != NEWFS_ERROR_NONE) {
-        return -NEWFS_ERROR_IO;
+    for (k = 0; k < blks; k++) {
+        if (newfs_driver_read(NEWFS_DATA_BLK_OFS(newfs_extent_blk(inode, k)), 
+                              (uint8_t *)(inode->ind_extents + k * per), NEWFS_BLK_SZ()) != NEWFS_ERROR_NONE) {
+            goto err;
+        }
     }
-
-    free(newfs_super.map_data);
-
-    // ​ ④关闭驱动。
-    ddriver_close(NEWFS_DRIVER());
-
+    inode->ind_loaded = TRUE;
     return NEWFS_ERROR_NONE;
+err:                                                   /* 读了一半的映射不留着，下次重新读 */
+    free(inode->ind_extents);
+    free(inode->dind_ptrs);
+    inode->ind_extents = NULL;
+    inode->dind_ptrs   = NULL;
+    newfs_meta_charge(inode, -(long)(blks * per * sizeof(struct newfs_extent)));
+    if (blks > 1) {
+        newfs_meta_charge(inode, -(long)(NEWFS_PTRS_PER_BLK() * sizeof(int)));
+    }
+    return -NEWFS_ERROR_IO;
 }
 
-/*****************************
- * 创建目录和文件
- * ****************************/
+/**
+ * @brief 在数据位图上分配count个连续块，尽量靠近goal，并标记所在组的位图为脏
+ * 组内不存在的块已置位，因此分配到的连续段不会跨组
+ * @param goal 
+ * @param count 
+ * @return int 数据块号，空间不足返回-1
+ */
+static int newfs_alloc_blks(int goal, int count) {
+    int start = newfs_bitmap_alloc_near(&newfs_super.bmap_data, goal, count);
+    if (start >= 0) {
+        newfs_super.map_data_dirty[NEWFS_GROUP_OF(start)] = TRUE;
+    }
+    return start;
+}
 
 /**
- * 路径解析，得到父目录的dentry
- * @brief 
- * path: /qwe/ad  total_lvl = 2,
- *      1) find /'s inode       lvl = 1
- *      2) find qwe's dentry 
- *      3) find qwe's inode     lvl = 2
- *      4) find ad's dentry
- *
- * path: /qwe     total_lvl = 1,
- *      1) find /'s inode       lvl = 1
- *      2) find qwe's dentry
+ * @brief 归还一段连续数据块，所在组的数据位图置脏
  * 
- * @param path 
- * @return struct newfs_inode* 
+ * @param start 
+ * @param count 
  */
-struct newfs_dentry* newfs_lookup(const char * path, boolean* is_find, boolean* is_root) {
-    struct newfs_dentry* dentry_cursor = newfs_super.root_dentry;//设置一个游标(dentry_cursor)指向根目录的dentry
-    struct newfs_dentry* dentry_ret = NULL;
-    struct newfs_inode*  inode; 
-    int   total_lvl = newfs_calc_lvl(path);// 计算路径的总层级数(total_lvl)，然后根据路径逐层查找对应的dentry。
-    int   lvl = 0;
-    boolean is_hit;
-    char* fname = NULL;
-    char* path_cpy = (char*)malloc(sizeof(path));
-    *is_root = FALSE;
-    strcpy(path_cpy, path);
+static void newfs_free_blks(int start, int count) {
+    newfs_bitmap_clear(&newfs_super.bmap_data, start, count);
+    newfs_super.map_data_dirty[NEWFS_GROUP_OF(start)] = TRUE;
+    newfs_super.map_data_dirty[NEWFS_GROUP_OF((start + count - 1))] = TRUE;
+}
 
-    //如果路径是根目录("/")，则直接返回根目录的dentry
-    if (total_lvl == 0) {                           /* 根目录 */
-        *is_find = TRUE;
-        *is_root = TRUE;
-        dentry_ret = newfs_super.root_dentry;
+/**
+ * @brief 文件下一次分配数据块的期望位置：紧跟最后一个extent，空文件则取inode所在块组的数据区开头
+ * 
+ * @param inode 
+ * @return int 
+ */
+static int newfs_data_goal(struct newfs_inode * inode) {
+    struct newfs_extent* extent;
+    if (inode->extent_cnt > 0) {
+        extent = newfs_extent_at(inode, inode->extent_cnt - 1);
+        return extent->start + extent->len;
     }
+    return NEWFS_GROUP_OF(inode->ino) * NEWFS_GROUP_BITS();
+}
 
-    fname = strtok(path_cpy, "/");       
-    while (fname)
-    {   
-        lvl++;
-        if (dentry_cursor->inode == NULL) {           /* Cache机制 */
-            newfs_read_inode(dentry_cursor, dentry_cursor->ino);
-        }
-        // 找子
-        inode = dentry_cursor->inode;
-        //子是文件，函数会直接返回该子文件的dentry。
-        if (NEWFS_IS_REG(inode) && lvl < total_lvl) {
-            NEWFS_DBG("[%s] not a dir\n", __func__);
-            dentry_ret = inode->dentry;
-            break;
-        }
-        //是目录类型，则继续在该目录下查找下一级目录的dentry
-        if (NEWFS_IS_DIR(inode)) {
-            dentry_cursor = inode->dentrys;
-            is_hit        = FALSE;
-            // 函数会遍历该目录下的所有dentry，逐个与路径中的下一级目录名进行比较。
-            
-            while (dentry_cursor)
-            {
-                if (memcmp(dentry_cursor->fname, fname, strlen(fname)) == 0) {
-                    is_hit = TRUE;// 目录名匹配上了，退出
-                    break;
-                }
-                dentry_cursor = dentry_cursor->brother;
-            }
+/**
+ * @brief 撤销newfs_extent_reserve为第extent_cnt个extent新分配的间接块
+ * 随后的数据块没分配成功时调用，磁盘上和内存中都不留下没有extent的间接块
+ * @param inode 
+ */
+static void newfs_extent_unreserve(struct newfs_inode * inode) {
+    int per = NEWFS_EXTENTS_PER_BLK();
+    int i   = inode->extent_cnt - NEWFS_EXTENT_CNT;
+    int k;
 
-           // 如果在当前目录下找不到匹配的dentry，则表示路径中的某一级目录不存在，此时函数会返回当前目录的dentry。
-            if (!is_hit) {
-                *is_find = FALSE;
-                NEWFS_DBG("[%s] not found %s\n", __func__, fname);
-                dentry_ret = inode->dentry;
-                break;
-            }
-             //如果找到了路径中的最后一级目录的dentry，则表示路径有效，函数会返回该dentry。
-            if (is_hit && lvl == total_lvl) {
-                *is_find = TRUE;
-                dentry_ret = dentry_cursor;
-                break;
-            }
+    if (i < 0 || i % per != 0) {
+        return;
+    }
+    k = i / per;
+    if (k == 0 ? inode->block_pointer[NEWFS_IND] >= 0 : inode->dind_ptrs != NULL && inode->dind_ptrs[k - 1] >= 0) {
+        newfs_free_blks(newfs_extent_blk(inode, k), 1);
+        if (k == 0) {
+            inode->block_pointer[NEWFS_IND] = -1;
+            free(inode->ind_extents);
+            inode->ind_extents = NULL;
         }
-        fname = strtok(NULL, "/"); 
+        else {
+            inode->dind_ptrs[k - 1] = -1;
+            inode->ind_extents = (struct newfs_extent *)realloc(inode->ind_extents, 
+                                                                k * per * sizeof(struct newfs_extent));
+        }
+        newfs_meta_charge(inode, -(long)(per * sizeof(struct newfs_extent)));
     }
-    //最后，函数会确保返回的dentry中的inode已经被读取到内存中，并将其返回。
-    if (dentry_ret->inode == NULL) {
-        dentry_ret->inode = newfs_read_inode(dentry_ret, dentry_ret->ino);
+    if (k == 1 && inode->block_pointer[NEWFS_DIND] >= 0) {
+        newfs_free_blks(inode->block_pointer[NEWFS_DIND], 1);
+        inode->block_pointer[NEWFS_DIND] = -1;
+        free(inode->dind_ptrs);
+        inode->dind_ptrs = NULL;
+        newfs_meta_charge(inode, -(long)(NEWFS_PTRS_PER_BLK() * sizeof(int)));
     }
-    
-    return dentry_ret;
 }
 
 /**
- * @brief 计算路径的层级
- * exm: /av/c/d/f
- * -> lvl = 4
- * @param path 
+ * @brief 为第extent_cnt个extent准备位置，需要时分配新的间接块
+ * 
+ * @param inode 
  * @return int 
  */
-int newfs_calc_lvl(const char * path) {
-    // char* path_cpy = (char *)malloc(strlen(path));
-    // strcpy(path_cpy, path);
-    char* str = path;
-    int   lvl = 0;
-    if (strcmp(path, "/") == 0) {
-        return lvl;
+static int newfs_extent_reserve(struct newfs_inode * inode) {
+    int per = NEWFS_EXTENTS_PER_BLK();
+    int i   = inode->extent_cnt - NEWFS_EXTENT_CNT;
+    int k, blkno;
+
+    if (inode->extent_cnt >= NEWFS_MAX_EXTENTS()) {
+        return -NEWFS_ERROR_FBIG;
     }
-    while (*str != NULL) {
-        if (*str == '/') {
-            lvl++;
+    if (i < 0 || i % per != 0) {                       /* 直接extent，或当前extent块还有空位 */
+        return NEWFS_ERROR_NONE;
+    }
+
+    k = i / per;
+    if (k == 1 && inode->block_pointer[NEWFS_DIND] < 0) {
+        blkno = newfs_alloc_blks(newfs_data_goal(inode), 1);
+        if (blkno < 0) {
+            return -NEWFS_ERROR_NOSPACE;
         }
-        str++;
+        inode->block_pointer[NEWFS_DIND] = blkno;
+        inode->dind_ptrs = (int *)malloc(NEWFS_PTRS_PER_BLK() * sizeof(int));
+        memset(inode->dind_ptrs, 0xff, NEWFS_PTRS_PER_BLK() * sizeof(int));   /* 全部为-1 */
+        newfs_meta_charge(inode, NEWFS_PTRS_PER_BLK() * sizeof(int));
+    }
+    blkno = newfs_alloc_blks(newfs_data_goal(inode), 1);
+    if (blkno < 0) {
+        newfs_extent_unreserve(inode);                 /* 刚分配的二级间接块也不留 */
+        return -NEWFS_ERROR_NOSPACE;
+    }
+    if (k == 0) {
+        inode->block_pointer[NEWFS_IND] = blkno;
+    }
+    else {
+        inode->dind_ptrs[k - 1] = blkno;
     }
-    return lvl;
+    inode->ind_extents = (struct newfs_extent *)realloc(inode->ind_extents, 
+                                                        (k + 1) * per * sizeof(struct newfs_extent));
+    memset(inode->ind_extents + k * per, 0, per * sizeof(struct newfs_extent));
+    newfs_meta_charge(inode, per * sizeof(struct newfs_extent));
+    return NEWFS_ERROR_NONE;
 }
+
 /**
- * @brief 为一个inode分配dentry，采用头插法
- * 
+ * @brief 回写被修改过的间接块
+ * 只写包含 ext_dirty 及之后extent的块，二级间接块只在其下新增了extent块时写
  * @param inode 
- * @param dentry 
  * @return int 
  */
-int newfs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
-    //只需要修改父目录inode中的指针指向新增的dentry结构，
-    //新增的dentry的兄弟指针指向原来第一个子文件dentry即可。
-    newfs_alloc_data(dentry);
-    if (inode->dentrys == NULL) {
-        inode->dentrys = dentry;
+static int newfs_sync_extents(struct newfs_inode * inode) {
+    int per = NEWFS_EXTENTS_PER_BLK();
+    int from, last, k;
+
+    if (inode->extent_cnt <= NEWFS_EXTENT_CNT || inode->ext_dirty >= inode->extent_cnt) {
+        inode->ext_dirty = inode->extent_cnt;
+        return NEWFS_ERROR_NONE;
+    }
+
+    from = inode->ext_dirty > NEWFS_EXTENT_CNT ? inode->ext_dirty - NEWFS_EXTENT_CNT : 0;
+    last = (inode->extent_cnt - NEWFS_EXTENT_CNT - 1) / per;
+    for (k = from / per; k <= last; k++) {
+        if (newfs_driver_write(NEWFS_DATA_BLK_OFS(newfs_extent_blk(inode, k)), 
+                               (uint8_t *)(inode->ind_extents + k * per), NEWFS_BLK_SZ()) != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_IO;
+        }
+    }
+    if (last >= 1 && last * per >= from) {
+        if (newfs_driver_write(NEWFS_DATA_BLK_OFS(inode->block_pointer[NEWFS_DIND]), 
+                               (uint8_t *)inode->dind_ptrs, NEWFS_BLK_SZ()) != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_IO;
+        }
+    }
+    inode->ext_dirty = inode->extent_cnt;
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 读写文件的逻辑块 [blk, blk + blks)
+ * 按extent拆成若干物理连续段，每段一次驱动读写
+ * @param inode 
+ * @param blk 起始逻辑块
+ * @param buf 
+ * @param blks 块数，必须都已分配
+ * @param is_write 
+ * @return int 
+ */
+static int newfs_inode_io(struct newfs_inode * inode, int blk, uint8_t * buf, int blks, boolean is_write) {
+    int phys, run, ret;
+    while (blks > 0) {
+        phys = newfs_bmap(inode, blk, &run);
+        if (phys < 0) {
+            return -NEWFS_ERROR_IO;
+        }
+        run = run < blks ? run : blks;
+        ret = is_write ? newfs_driver_write(NEWFS_DATA_BLK_OFS(phys), buf, NEWFS_BLKS_SZ(run))
+                       : newfs_driver_read(NEWFS_DATA_BLK_OFS(phys), buf, NEWFS_BLKS_SZ(run));
+        if (ret != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_IO;
+        }
+        buf  += NEWFS_BLKS_SZ(run);
+        blk  += run;
+        blks -= run;
+    }
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 取得ino在inode表中的槽，所在块不在缓存时整块读入
+ * 同一块中的其他inode随之进入缓存，之后读取它们不再访问磁盘
+ * @param ino 
+ * @return struct newfs_inode_d* 读盘失败返回NULL
+ */
+static struct newfs_inode_d* newfs_itable_slot(int ino) {
+    int      idx = NEWFS_ITABLE_IDX(ino);
+    uint8_t* blk = newfs_super.itable[idx];
+
+    if (blk == NULL) {
+        blk = (uint8_t *)malloc(NEWFS_BLK_SZ());
+        if (newfs_driver_read(NEWFS_ITABLE_BLK_OFS(ino), blk, NEWFS_BLK_SZ()) != NEWFS_ERROR_NONE) {
+            free(blk);
+            return NULL;
+        }
+        newfs_super.itable[idx] = blk;
+    }
+    return (struct newfs_inode_d *)(blk + ino % NEWFS_INODES_PER_BLK() * NEWFS_INODE_SZ);
+}
+
+/**
+ * @brief 标记ino所在的inode表块为脏
+ * 
+ * @param ino 
+ */
+static void newfs_itable_mark_dirty(int ino) {
+    int idx = NEWFS_ITABLE_IDX(ino);
+    if (!newfs_super.itable_dirty[idx]) {
+        newfs_super.itable_dirty[idx] = TRUE;
+        newfs_super.itable_dirty_list[newfs_super.itable_dirty_cnt++] = idx;
+    }
+}
+
+/**
+ * @brief 第idx个inode表块在磁盘上的偏移，各组的inode表块依次编号
+ * 
+ * @param idx 
+ * @return int 
+ */
+static int newfs_itable_blk_ofs(int idx) {
+    return newfs_super.inode_offset + NEWFS_GROUP_OFS(idx / NEWFS_ITABLE_BLKS() * NEWFS_GROUP_BITS()) + 
+           NEWFS_BLKS_SZ((idx % NEWFS_ITABLE_BLKS()));
+}
+
+/**
+ * @brief 整块写回所有脏的inode表块，同一块中的多个inode只写一次
+ * 
+ * @return int 
+ */
+static int newfs_itable_flush() {
+    int idx;
+    while (newfs_super.itable_dirty_cnt > 0) {
+        idx = newfs_super.itable_dirty_list[newfs_super.itable_dirty_cnt - 1];
+        if (newfs_driver_write(newfs_itable_blk_ofs(idx), newfs_super.itable[idx], NEWFS_BLK_SZ()) != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_IO;
+        }
+        newfs_super.itable_dirty[idx] = FALSE;
+        newfs_super.itable_dirty_cnt--;
+    }
+    return NEWFS_ERROR_NONE;
+}
+
+static int newfs_int_cmp(const void* a, const void* b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/**
+ * @brief 把一批inode所在、还不在缓存中的inode表块读进缓存
+ * 按块号排序去重，同一组中相邻或只隔几块的合成一次顺序读，中间顺带读到的块也放进缓存。
+ * readdir交出一批目录项后调用，接下来逐个getattr时inode都已在内存里
+ * @param inos 会被改写
+ * @param n 
+ * @return int 
+ */
+int newfs_itable_prefetch(int* inos, int n) {
+    uint8_t* buf = NULL;
+    int i, j, m = 0, idx, first, last;
+
+    for (i = 0; i < n; i++) {                          /* 换成块下标，只留不在缓存中的 */
+        idx = NEWFS_ITABLE_IDX(inos[i]);
+        if (newfs_super.itable[idx] == NULL) {
+            inos[m++] = idx;
+        }
+    }
+    qsort(inos, m, sizeof(int), newfs_int_cmp);
+    for (i = 0; i < m; i = j) {
+        first = last = inos[i];
+        for (j = i + 1; j < m; j++) {
+            if (inos[j] - last > NEWFS_PREFETCH_GAP + 1 || inos[j] - first >= NEWFS_PREFETCH_RUN ||
+                inos[j] / NEWFS_ITABLE_BLKS() != first / NEWFS_ITABLE_BLKS()) {
+                break;
+            }
+            last = inos[j];
+        }
+        if (buf == NULL) {
+            buf = (uint8_t *)malloc(NEWFS_BLKS_SZ(NEWFS_PREFETCH_RUN));
+        }
+        if (newfs_driver_read(newfs_itable_blk_ofs(first), buf, NEWFS_BLKS_SZ((last - first + 1))) != NEWFS_ERROR_NONE) {
+            free(buf);
+            return -NEWFS_ERROR_IO;
+        }
+        for (idx = first; idx <= last; idx++) {
+            if (newfs_super.itable[idx] == NULL) {     /* 已在缓存中的可能是脏的，不能覆盖 */
+                newfs_super.itable[idx] = (uint8_t *)malloc(NEWFS_BLK_SZ());
+                memcpy(newfs_super.itable[idx], buf + NEWFS_BLKS_SZ((idx - first)), NEWFS_BLK_SZ());
+            }
+        }
+    }
+    free(buf);
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 目录内联在inode槽中时，全部目录项紧凑排列所需的字节数
+ * 
+ * @param inode 
+ * @return int 
+ */
+static int newfs_dir_inline_sz(struct newfs_inode * inode) {
+    struct newfs_dentry* dentry_cursor = inode->dentrys;
+    int sz = 0;
+    while (dentry_cursor != NULL) {
+        sz += NEWFS_DENTRY_SZ(dentry_cursor->name_len);
+        dentry_cursor = dentry_cursor->brother;
+    }
+    return sz;
+}
+
+/**
+ * @brief 把一个目录项按变长格式写到buf
+ * 
+ * @param buf 
+ * @param dentry 
+ */
+static void newfs_pack_dentry(uint8_t* buf, struct newfs_dentry* dentry) {
+    struct newfs_dentry_d* dentry_d = (struct newfs_dentry_d *)buf;
+    dentry_d->name_len = dentry->name_len;
+    dentry_d->rec_len  = NEWFS_DENTRY_SZ(dentry_d->name_len);
+    dentry_d->ftype    = dentry->ftype;
+    dentry_d->ino      = dentry->ino;
+    memcpy(dentry_d->fname, dentry->fname, dentry_d->name_len);
+    dentry->flag &= ~NEWFS_FLAG_DIRTY;
+}
+
+/**
+ * @brief 文件名散列，FNV-1a
+ * 
+ * @param fname 
+ * @return uint32_t 
+ */
+uint32_t newfs_hash_name(const char* fname) {
+    uint32_t hash = 2166136261u;
+    while (*fname) {
+        hash = (hash ^ (uint8_t)*fname++) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief 把dentry挂进目录的散列表，目录项多于桶数时桶数翻倍并重新散列
+ * 
+ * @param inode 
+ * @param dentry 
+ */
+static void newfs_hash_insert(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    struct newfs_dentry** buckets;
+    struct newfs_dentry*  cursor;
+    struct newfs_dentry*  next;
+    int sz, i;
+
+    if (inode->dhash_cnt >= inode->dhash_sz) {
+        sz      = inode->dhash_sz == 0 ? 8 : inode->dhash_sz * 2;
+        buckets = (struct newfs_dentry **)calloc(sz, sizeof(struct newfs_dentry *));
+        for (i = 0; i < inode->dhash_sz; i++) {
+            for (cursor = inode->dhash[i]; cursor != NULL; cursor = next) {
+                next = cursor->hash_next;
+                cursor->hash_next = buckets[cursor->hash & (sz - 1)];
+                buckets[cursor->hash & (sz - 1)] = cursor;
+            }
+        }
+        free(inode->dhash);
+        newfs_meta_charge(inode, (sz - inode->dhash_sz) * sizeof(struct newfs_dentry *));
+        inode->dhash    = buckets;
+        inode->dhash_sz = sz;
+    }
+    i = dentry->hash & (inode->dhash_sz - 1);
+    dentry->hash_next = inode->dhash[i];
+    inode->dhash[i]   = dentry;
+    inode->dhash_cnt++;
+}
+
+/**
+ * @brief 目录中是否记着名字不存在
+ * 
+ * @param inode 
+ * @param name 不必以'\0'结尾
+ * @param len 
+ * @param hash name的散列
+ * @return boolean 
+ */
+static boolean newfs_neg_test(struct newfs_inode* inode, const char* name, int len, uint32_t hash) {
+    struct newfs_neg_ent* ent;
+    if (inode->neg == NULL) {
+        return FALSE;
+    }
+    ent = &inode->neg[hash & (NEWFS_NEG_SLOTS - 1)];
+    return ent->name[0] != '\0' && ent->hash == hash && 
+           strncmp(ent->name, name, len) == 0 && ent->name[len] == '\0';
+}
+
+/**
+ * @brief 记下名字在目录中不存在，同槽的旧项被替换，首次未命中时才分配
+ * 
+ * @param inode 
+ * @param name 
+ * @param len 
+ * @param hash 
+ */
+static void newfs_neg_add(struct newfs_inode* inode, const char* name, int len, uint32_t hash) {
+    struct newfs_neg_ent* ent;
+    if (len >= NEWFS_MAX_FILE_NAME) {
+        return;
+    }
+    if (inode->neg == NULL) {
+        inode->neg = (struct newfs_neg_ent *)calloc(NEWFS_NEG_SLOTS, sizeof(struct newfs_neg_ent));
+        newfs_meta_charge(inode, NEWFS_NEG_SLOTS * sizeof(struct newfs_neg_ent));
+    }
+    ent = &inode->neg[hash & (NEWFS_NEG_SLOTS - 1)];
+    ent->hash = hash;
+    memcpy(ent->name, name, len);
+    ent->name[len] = '\0';
+}
+
+/**
+ * @brief 目录中加入名字时作废其不存在的记录
+ * 
+ * @param inode 
+ * @param name 
+ * @param len 
+ * @param hash 
+ */
+static void newfs_neg_drop(struct newfs_inode* inode, const char* name, int len, uint32_t hash) {
+    if (newfs_neg_test(inode, name, len, hash)) {
+        inode->neg[hash & (NEWFS_NEG_SLOTS - 1)].name[0] = '\0';
+    }
+}
+
+/**
+ * @brief 名字散列在Bloom过滤器中的第i个位置，用两个散列组合出NEWFS_BLOOM_K个
+ * 
+ * @return uint32_t 
+ */
+static inline uint32_t newfs_bloom_bit(struct newfs_inode* inode, uint32_t hash, int i) {
+    return (hash + i * ((hash >> 17) | (hash << 15))) & (inode->bloom_bits - 1);
+}
+
+static void newfs_bloom_add(struct newfs_inode* inode, uint32_t hash) {
+    uint32_t bit;
+    int i;
+    for (i = 0; i < NEWFS_BLOOM_K; i++) {
+        bit = newfs_bloom_bit(inode, hash, i);
+        inode->bloom[bit / UINT8_BITS] |= 1 << (bit % UINT8_BITS);
+    }
+    inode->bloom_cnt++;
+}
+
+/**
+ * @brief Bloom过滤器判断名字是否可能在目录中
+ * 
+ * @return boolean FALSE表示一定不在
+ */
+static boolean newfs_bloom_test(struct newfs_inode* inode, uint32_t hash) {
+    uint32_t bit;
+    int i;
+    for (i = 0; i < NEWFS_BLOOM_K; i++) {
+        bit = newfs_bloom_bit(inode, hash, i);
+        if (!(inode->bloom[bit / UINT8_BITS] & (1 << (bit % UINT8_BITS)))) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * @brief 按当前目录项重建Bloom过滤器，留出一倍余量；要求目录项已全部读入内存
+ * 删除不清位，加入的名字超出容量时再重建，顺带清掉已删除名字留下的位
+ * @param inode 
+ */
+static void newfs_bloom_build(struct newfs_inode* inode) {
+    struct newfs_dentry* dentry_cursor;
+    int bits = UINT8_BITS * sizeof(uint64_t);
+
+    while (bits < inode->dir_cnt * 2 * NEWFS_BLOOM_BITS_PER_NAME) {
+        bits *= 2;
+    }
+    if (inode->bloom != NULL) {
+        newfs_meta_charge(inode, -(long)(inode->bloom_bits / UINT8_BITS));
+    }
+    free(inode->bloom);
+    inode->bloom      = (uint8_t *)calloc(bits / UINT8_BITS, 1);
+    newfs_meta_charge(inode, bits / UINT8_BITS);
+    inode->bloom_bits = bits;
+    inode->bloom_cnt  = 0;
+    for (dentry_cursor = inode->dentrys; dentry_cursor != NULL; dentry_cursor = dentry_cursor->brother) {
+        newfs_bloom_add(inode, dentry_cursor->hash);
+    }
+}
+
+/**
+ * @brief 把dentry挂到第b个目录块的链表上，计入该块的占用
+ * 
+ * @param inode 
+ * @param dentry 
+ * @param b 
+ */
+static void newfs_dir_chain(struct newfs_inode* inode, struct newfs_dentry* dentry, int b) {
+    dentry->dblk     = b;
+    dentry->blk_next = inode->dblks[b].dentrys;
+    inode->dblks[b].dentrys = dentry;
+    inode->dblks[b].used   += NEWFS_DENTRY_SZ(dentry->name_len);
+}
+
+/**
+ * @brief 把dentry从所在目录块的链表上摘下，该块变脏
+ * 
+ * @param inode 
+ * @param dentry 
+ */
+static void newfs_dir_unchain(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    struct newfs_dentry** cursor = &inode->dblks[dentry->dblk].dentrys;
+    while (*cursor != dentry) {
+        cursor = &(*cursor)->blk_next;
+    }
+    *cursor = dentry->blk_next;
+    inode->dblks[dentry->dblk].used -= NEWFS_DENTRY_SZ(dentry->name_len);
+    inode->dblks[dentry->dblk].dirty = TRUE;
+}
+
+/**
+ * @brief 把dentry挂进目录：散列表、目录项链表，以及所在目录块的链表
+ * 不改变dir_cnt，从磁盘读入的目录项也走这里
+ * @param inode 
+ * @param dentry dblk为-1表示目录内联
+ */
+static void newfs_dir_link(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    newfs_hash_insert(inode, dentry);
+    dentry->brother = inode->dentrys;
+    inode->dentrys  = dentry;
+    if (dentry->dblk >= 0) {
+        newfs_dir_chain(inode, dentry, dentry->dblk);
+    }
+}
+
+/**
+ * @brief 创建目录项：dentry从dentry分配器中取，名字存进文件名区，长度和散列一并算好
+ * 
+ * @param name 不必以'\0'结尾
+ * @param len 
+ * @param ftype 
+ * @return struct newfs_dentry* 
+ */
+static struct newfs_dentry* newfs_new_dentry_name(const char* name, int len, NEWFS_FILE_TYPE ftype) {
+    struct newfs_dentry * dentry = (struct newfs_dentry *)newfs_slab_alloc(&newfs_super.dentry_slab);
+    dentry->fname    = newfs_name_alloc(name, len);
+    dentry->name_len = len;
+    dentry->hash     = newfs_hash_name(dentry->fname);
+    dentry->ftype    = ftype;
+    dentry->ino      = -1;
+    dentry->dblk     = -1;
+    return dentry;
+}
+
+/**
+ * @brief 解析一段变长目录项记录并挂进目录
+ * 
+ * @param inode 
+ * @param buf 
+ * @param len buf的长度
+ * @param b 记录所在的目录块，内联目录为-1
+ */
+static void newfs_dir_parse(struct newfs_inode* inode, uint8_t* buf, int len, int b) {
+    struct newfs_dentry_d* dentry_d;
+    struct newfs_dentry*   sub_dentry;
+    int    pos = 0;
+
+    while (pos + (int)sizeof(struct newfs_dentry_d) <= len) {
+        dentry_d = (struct newfs_dentry_d *)(buf + pos);
+        if (dentry_d->rec_len == 0) {
+            break;
+        }
+        sub_dentry = newfs_new_dentry_name(dentry_d->fname, dentry_d->name_len, 
+                                           (NEWFS_FILE_TYPE)dentry_d->ftype);
+        sub_dentry->parent = inode->dentry;
+        sub_dentry->ino    = dentry_d->ino; 
+        sub_dentry->dblk   = b;
+        newfs_dir_link(inode, sub_dentry);
+        pos += dentry_d->rec_len;
+    }
+}
+
+/**
+ * @brief 读入第b个目录块：索引块保留原始内容，叶子块解析成目录项
+ * 
+ * @param inode 
+ * @param b 
+ * @param is_index 
+ * @param image 目录全部块的映像，非NULL时从中取出该块，不再读盘
+ * @return int 
+ */
+static int newfs_dir_load_blk_from(struct newfs_inode* inode, int b, boolean is_index, const uint8_t* image) {
+    uint8_t* buf;
+
+    if (inode->dblks[b].loaded) {
+        return NEWFS_ERROR_NONE;
+    }
+    buf = (uint8_t *)malloc(NEWFS_BLK_SZ());
+    if (image != NULL) {
+        memcpy(buf, image + NEWFS_BLKS_SZ(b), NEWFS_BLK_SZ());
+    }
+    else if (newfs_inode_io(inode, b, buf, 1, FALSE) != NEWFS_ERROR_NONE) {
+        free(buf);
+        return -NEWFS_ERROR_IO;
+    }
+    if (is_index) {
+        inode->dblks[b].dx = buf;
+        newfs_meta_charge(inode, NEWFS_BLK_SZ());
+    }
+    else {
+        newfs_dir_parse(inode, buf, NEWFS_BLK_SZ(), b);
+        free(buf);
+    }
+    inode->dblks[b].loaded = TRUE;
+    return NEWFS_ERROR_NONE;
+}
+
+static int newfs_dir_load_blk(struct newfs_inode* inode, int b, boolean is_index) {
+    return newfs_dir_load_blk_from(inode, b, is_index, NULL);
+}
+
+// newfs_read_inode 函数作用是从磁盘中读取inode节点
+/**
+ * @brief 
+ * 
+ * @param dentry dentry指向ino，读取该inode
+ * @param ino inode唯一编号
+ * @return struct newfs_inode* 
+ */
+struct newfs_inode* newfs_read_inode(struct newfs_dentry * dentry, int ino) {
+    struct newfs_inode* inode;
+    struct newfs_inode_d inode_d;
+    struct newfs_inode_d* slot;
+    uint8_t* image = NULL;
+    int    b;
+    // ①从inode表块缓存中取出ino号的inode，所在块不在缓存时才读盘。
+    slot = newfs_itable_slot(ino);
+    if (slot == NULL) {
+        NEWFS_DBG("[%s] io error\n", __func__);
+        return NULL;                    
+    }
+    inode = (struct newfs_inode*)newfs_slab_alloc(&newfs_super.inode_slab);
+    memcpy(&inode_d, slot, sizeof(struct newfs_inode_d));
+    inode->dir_cnt = inode_d.dir_cnt;
+    inode->iflags = inode_d.iflags;
+    inode->ino = inode_d.ino;
+    inode->size = inode_d.size;
+    inode->dentry = dentry;
+    inode->dentrys = NULL;
+    inode->dblks = NULL;
+    inode->dhash = NULL;
+    inode->dhash_sz = 0;
+    inode->dhash_cnt = 0;
+    inode->neg     = NULL;
+    inode->bloom   = NULL;
+    inode->pages = NULL;                               /* 文件数据按需读入 */
+    inode->page_cnt = 0;
+    inode->flag = 0;                                   /* 刚从磁盘读入，是干净的 */
+    inode->dirty_prev = NULL;
+    inode->dirty_next = NULL;
+    inode->extent_cnt = inode_d.extent_cnt;
+    inode->blk_cnt    = inode_d.blk_cnt;
+    memcpy(inode->extents, inode_d.extents, sizeof(inode->extents));
+    memcpy(inode->block_pointer, inode_d.block_pointer, sizeof(inode->block_pointer));
+    inode->ind_extents    = NULL;                      /* 间接块等到第一次映射到时再读 */
+    inode->dind_ptrs      = NULL;
+    inode->meta_bytes     = 0;
+    inode->ind_loaded     = inode->extent_cnt <= NEWFS_EXTENT_CNT;
+    inode->ext_dirty      = inode->extent_cnt;
+    inode->ext_cursor     = 0;
+    inode->ext_cursor_blk = 0;
+    //​ ② 判断inode的文件类型，如果是目录类型则需要读取每一个目录项并建立连接。
+    /*判断iNode节点的文件类型*/
+    if (NEWFS_IS_DIR(inode)) {/*如果是目录的话需要将目录项建立连接*/
+        if (NEWFS_IS_INLINE_DIR(inode)) {           /* 内联目录：记录就在inode槽里，不用再读盘 */
+            newfs_dir_parse(inode, inode_d.inline_data, NEWFS_INLINE_SZ, -1);
+        }
+        else if (NEWFS_IS_INDEXED(inode)) {         /* 带索引的目录：查找时才沿索引读入用到的块 */
+            inode->dblks = (struct newfs_dir_blk *)calloc(inode->blk_cnt, sizeof(struct newfs_dir_blk));
+            newfs_meta_charge(inode, inode->blk_cnt * sizeof(struct newfs_dir_blk));
+        }
+        else {                                      /* 线性目录：每个extent一次，读出全部目录块 */
+            inode->dblks = (struct newfs_dir_blk *)calloc(inode->blk_cnt, sizeof(struct newfs_dir_blk));
+            newfs_meta_charge(inode, inode->blk_cnt * sizeof(struct newfs_dir_blk));
+            image = (uint8_t *)malloc(NEWFS_BLKS_SZ(inode->blk_cnt));
+            if (newfs_inode_io(inode, 0, image, inode->blk_cnt, FALSE) != NEWFS_ERROR_NONE) {
+                NEWFS_DBG("[%s] io error\n", __func__);
+                free(image);
+                free(inode->dblks);
+                newfs_meta_charge(inode, -inode->meta_bytes);
+                newfs_slab_free(&newfs_super.inode_slab, inode);
+                return NULL;                    
+            }
+            for (b = 0; b < inode->blk_cnt; b++) {
+                newfs_dir_parse(inode, image + NEWFS_BLKS_SZ(b), NEWFS_BLK_SZ(), b);
+                inode->dblks[b].loaded = TRUE;
+            }
+            free(image);
+        }
+    }
+    //③文件数据不在这里读，等到第一次读写对应块时由newfs_get_page读入
+    if (dentry->parent != NULL) {
+        newfs_lru_pin(dentry->parent->inode);
+    }
+    newfs_lru_add(inode, FALSE);
+    return inode;
+}
+
+
+/**
+ * @brief 标记inode为脏，并挂入超级块的脏链表
+ * 
+ * @param inode 
+ * @param flag NEWFS_FLAG_DIRTY: inode头/目录项需要回写；NEWFS_FLAG_DATA_DIRTY: 文件数据需要回写
+ */
+void newfs_mark_inode_dirty(struct newfs_inode * inode, flag16 flag) {
+    if (inode->flag == 0) {                            /* 头插进脏链表 */
+        inode->dirty_prev = NULL;
+        inode->dirty_next = newfs_super.dirty_inodes;
+        if (newfs_super.dirty_inodes != NULL) {
+            newfs_super.dirty_inodes->dirty_prev = inode;
+        }
+        newfs_super.dirty_inodes = inode;
+    }
+    inode->flag |= flag;
+}
+
+/**
+ * @brief 标记目录项为脏，其父目录inode同时变脏
+ * 
+ * @param dentry 
+ */
+void newfs_mark_dentry_dirty(struct newfs_dentry * dentry) {
+    dentry->flag |= NEWFS_FLAG_DIRTY;
+    newfs_mark_inode_dirty(dentry->parent->inode, NEWFS_FLAG_DIRTY);
+}
+
+/**
+ * @brief 获取文件第blk块的内存页，按需从磁盘读入
+ * 只有首次访问某块时才产生一次块读；文件尾之后的块或将被覆盖的部分无需读盘。
+ * 页只按文件实际内容大小分配（NEWFS_PAGE_ALIGN对齐），内存占用与文件大小成正比
+ * @param inode 
+ * @param blk 文件内块号，读取时必须已分配
+ * @param need 调用者要访问页内 [0, need) 的字节
+ * @param overwrite 调用者将覆盖块内全部有效内容，不必读出旧内容
+ * @return uint8_t* 
+ * 内联文件只有第0页，内容从inode槽中复制，不另外读盘
+ */
+uint8_t* newfs_get_page(struct newfs_inode * inode, int blk, int need, boolean overwrite) {
+    struct newfs_page* page;
+    struct newfs_inode_d* slot;
+    int valid, sz;
+
+    if (blk >= inode->page_cnt) {                      /* 页表随文件增长 */
+        inode->pages = (struct newfs_page *)realloc(inode->pages, 
+                                                   (blk + 1) * sizeof(struct newfs_page));
+        memset(inode->pages + inode->page_cnt, 0, 
+               (blk + 1 - inode->page_cnt) * sizeof(struct newfs_page));
+        inode->page_cnt = blk + 1;
+    }
+    page = &inode->pages[blk];
+
+    /* 该块在文件中的有效字节数 */
+    valid = inode->size - NEWFS_BLKS_SZ(blk);
+    valid = valid < 0 ? 0 : (valid > NEWFS_BLK_SZ() ? NEWFS_BLK_SZ() : valid);
+
+    if (page->flag & NEWFS_PAGE_PRESENT) {
+        if (page->sz < need) {                         /* 尾页变长 */
+            sz = NEWFS_ROUND_UP(need, NEWFS_PAGE_ALIGN);
+            page->data = (uint8_t *)realloc(page->data, sz);
+            memset(page->data + page->sz, 0, sz - page->sz);
+            newfs_super.page_bytes += sz - page->sz;
+            page->sz = sz;
+        }
+        return page->data;
+    }
+
+    sz = need > valid ? need : valid;
+    sz = sz == 0 ? NEWFS_PAGE_ALIGN : NEWFS_ROUND_UP(sz, NEWFS_PAGE_ALIGN);
+    page->data = (uint8_t *)calloc(1, sz);
+    if (!overwrite && valid > 0 && NEWFS_IS_INLINE(inode)) {  /* 内联数据取自inode表块缓存 */
+        slot = newfs_itable_slot(inode->ino);
+        if (slot == NULL) {
+            NEWFS_DBG("[%s] io error\n", __func__);
+            free(page->data);
+            page->data = NULL;
+            return NULL;
+        }
+        memcpy(page->data, slot->inline_data, valid);
+    }
+    else if (!overwrite && valid > 0) {
+        if (newfs_driver_read(NEWFS_DATA_BLK_OFS(newfs_bmap(inode, blk, NULL)), 
+                              page->data, valid) != NEWFS_ERROR_NONE) {
+            NEWFS_DBG("[%s] io error\n", __func__);
+            free(page->data);
+            page->data = NULL;
+            return NULL;
+        }
+    }
+    page->sz    = sz;
+    page->flag |= NEWFS_PAGE_PRESENT;
+    newfs_super.page_bytes += sz;
+    return page->data;
+}
+
+/**
+ * @brief 将inode从脏链表摘下
+ * 
+ * @param inode 
+ */
+static void newfs_clear_inode_dirty(struct newfs_inode * inode) {
+    if (inode->dirty_prev != NULL) {
+        inode->dirty_prev->dirty_next = inode->dirty_next;
+    }
+    else {
+        newfs_super.dirty_inodes = inode->dirty_next;
+    }
+    if (inode->dirty_next != NULL) {
+        inode->dirty_next->dirty_prev = inode->dirty_prev;
+    }
+    inode->dirty_prev = NULL;
+    inode->dirty_next = NULL;
+    inode->flag       = 0;
+}
+
+/**
+ * @brief 将一个脏inode刷回磁盘，只写被修改过的部分，不再递归整棵树
+ * 
+ * inode只更新表块缓存中的槽，内联小文件的数据和小目录的目录项也一并放进槽里；其余数据按extent映射到物理块，
+ * 目录项数组在内存中拼成镜像后每个extent一次写入，文件则只写脏块组成的连续段
+ * @param inode 
+ * @return int 
+ */
+int newfs_sync_inode(struct newfs_inode * inode) {
+    struct newfs_inode_d*  inode_d;
+    struct newfs_dentry*   dentry_cursor;
+    uint8_t*               image;
+    int                    blk = 0, i, j, pos;
+    int ino             = inode->ino;
+
+    if (inode->flag == 0) {                            /* 干净的inode无需回写 */
+        return NEWFS_ERROR_NONE;
+    }
+
+    // ①更新inode表块缓存中的槽，表块在newfs_sync_dirty中整块写回
+                                                      /* Cycle 1: 写 INODE */
+    if (inode->flag & NEWFS_FLAG_DIRTY) {
+        if (NEWFS_IS_INLINE(inode) && inode->size > 0 &&     /* 槽要清零，先把内联数据读到页里 */
+            newfs_get_page(inode, 0, inode->size, FALSE) == NULL) {
+            NEWFS_DBG("[%s] io error\n", __func__);
+            return -NEWFS_ERROR_IO;
+        }
+        inode_d = newfs_itable_slot(ino);
+        if (inode_d == NULL) {
+            NEWFS_DBG("[%s] io error\n", __func__);
+            return -NEWFS_ERROR_IO;
+        }
+        memset(inode_d, 0, NEWFS_INODE_SZ);
+        inode_d->ino        = ino;
+        inode_d->size       = inode->size;
+        inode_d->ftype      = inode->dentry->ftype;
+        inode_d->dir_cnt    = inode->dir_cnt;
+        inode_d->extent_cnt = inode->extent_cnt;
+        inode_d->blk_cnt    = inode->blk_cnt;
+        inode_d->iflags     = inode->iflags;
+        memcpy(inode_d->extents, inode->extents, sizeof(inode->extents));
+        memcpy(inode_d->block_pointer, inode->block_pointer, sizeof(inode->block_pointer));
+        if (NEWFS_IS_INLINE(inode) && inode->size > 0) {   /* 小文件数据随inode一起写回 */
+            memcpy(inode_d->inline_data, inode->pages[0].data, inode->size);
+            inode->pages[0].flag &= ~NEWFS_PAGE_DIRTY;
+        }
+        if (NEWFS_IS_INLINE_DIR(inode)) {               /* 链表是逆序加入的，从尾部往前放，读回时顺序不变 */
+            pos           = newfs_dir_inline_sz(inode);
+            dentry_cursor = inode->dentrys;
+            while (dentry_cursor != NULL)
+            {
+                pos -= NEWFS_DENTRY_SZ(dentry_cursor->name_len);
+                newfs_pack_dentry(inode_d->inline_data + pos, dentry_cursor);
+                dentry_cursor = dentry_cursor->brother;
+            }
+        }
+        newfs_itable_mark_dirty(ino);
+
+        if (newfs_sync_extents(inode) != NEWFS_ERROR_NONE) {
+            NEWFS_DBG("[%s] io error\n", __func__);
+            return -NEWFS_ERROR_IO;
+        }
+    }
+
+    // ②目录只重写脏的目录块：块内记录从头紧凑排列，删除留下的空洞随之消失；索引块原样写回
+                                                      /* Cycle 2: 写 数据 */
+    if (NEWFS_IS_DIR(inode) && !NEWFS_IS_INLINE_DIR(inode) && (inode->flag & NEWFS_FLAG_DIRTY)) {
+        while (blk < inode->blk_cnt) {                 /* 连续的脏块一次写 */
+            if (!inode->dblks[blk].dirty) {
+                blk++;
+                continue;
+            }
+            for (i = blk; i < inode->blk_cnt && inode->dblks[i].dirty; i++);
+            image = (uint8_t *)calloc(1, NEWFS_BLKS_SZ((i - blk)));
+            for (j = blk; j < i; j++) {
+                if (inode->dblks[j].dx != NULL) {
+                    memcpy(image + NEWFS_BLKS_SZ((j - blk)), inode->dblks[j].dx, NEWFS_BLK_SZ());
+                }
+                pos = inode->dblks[j].used;            /* 链表是逆序加入的，从块内尾部往前放，读回时顺序不变 */
+                for (dentry_cursor = inode->dblks[j].dentrys; dentry_cursor != NULL; 
+                     dentry_cursor = dentry_cursor->blk_next) {
+                    pos -= NEWFS_DENTRY_SZ(dentry_cursor->name_len);
+                    newfs_pack_dentry(image + NEWFS_BLKS_SZ((j - blk)) + pos, dentry_cursor);
+                }
+                inode->dblks[j].dirty = FALSE;
+            }
+            if (newfs_inode_io(inode, blk, image, i - blk, TRUE) != NEWFS_ERROR_NONE) {
+                NEWFS_DBG("[%s] io error\n", __func__);
+                free(image);
+                return -NEWFS_ERROR_IO;
+            }
+            free(image);
+            blk = i;
+        }
+        blk = 0;
+    }
+
+    // ③文件的脏块按逻辑连续段拼起来写回，干净块不动；内联文件已在①中写入
+    if (NEWFS_IS_REG(inode) && !NEWFS_IS_INLINE(inode) && (inode->flag & NEWFS_FLAG_DATA_DIRTY)) {
+        while (blk < inode->page_cnt) {
+            if (!(inode->pages[blk].flag & NEWFS_PAGE_DIRTY)) {
+                blk++;
+                continue;
+            }
+            for (i = blk; i < inode->page_cnt && (inode->pages[i].flag & NEWFS_PAGE_DIRTY); i++);
+            image = (uint8_t *)calloc(1, NEWFS_BLKS_SZ((i - blk)));
+            for (j = blk; j < i; j++) {
+                memcpy(image + NEWFS_BLKS_SZ((j - blk)), inode->pages[j].data, inode->pages[j].sz);
+                inode->pages[j].flag &= ~NEWFS_PAGE_DIRTY;
+            }
+            if (newfs_inode_io(inode, blk, image, i - blk, TRUE) != NEWFS_ERROR_NONE) {
+                NEWFS_DBG("[%s] io error\n", __func__);
+                free(image);
+                return -NEWFS_ERROR_IO;
+            }
+            free(image);
+            blk = i;
+        }
+    }
+    newfs_clear_inode_dirty(inode);
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 清空脏链表：回写所有被修改的inode以及被修改的位图
+ * I/O量与修改量成正比，而不是与整个文件系统大小成正比
+ * 
+ * @return int 
+ */
+int newfs_sync_dirty() {
+    int ret, g;
+    while (newfs_super.dirty_inodes != NULL) {
+        ret = newfs_sync_inode(newfs_super.dirty_inodes);
+        if (ret != NEWFS_ERROR_NONE) {
+            return ret;
+        }
+    }
+
+    if (newfs_itable_flush() != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+
+    for (g = 0; g < newfs_super.group_cnt; g++) {   /* 只写被修改过的组的位图块 */
+        if (newfs_super.map_inode_dirty[g]) {
+            if (newfs_driver_write(newfs_super.map_inode_offset + NEWFS_GROUP_OFS(g * NEWFS_GROUP_BITS()), 
+                                   newfs_super.map_inode + NEWFS_BLKS_SZ(g), NEWFS_BLK_SZ()) != NEWFS_ERROR_NONE) {
+                return -NEWFS_ERROR_IO;
+            }
+            newfs_super.map_inode_dirty[g] = FALSE;
+        }
+        if (newfs_super.map_data_dirty[g]) {
+            if (newfs_driver_write(newfs_super.map_data_offset + NEWFS_GROUP_OFS(g * NEWFS_GROUP_BITS()), 
+                                   newfs_super.map_data + NEWFS_BLKS_SZ(g), NEWFS_BLK_SZ()) != NEWFS_ERROR_NONE) {
+                return -NEWFS_ERROR_IO;
+            }
+            newfs_super.map_data_dirty[g] = FALSE;
+        }
+    }
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 释放inode在内存中挂着的缓冲区（文件页、extent间接块、目录块、散列表等），inode本身不释放
+ * 
+ * @param inode 
+ */
+static void newfs_release_inode(struct newfs_inode* inode) {
+    int i;
+    for (i = 0; i < inode->page_cnt; i++) {
+        free(inode->pages[i].data);
+        newfs_super.page_bytes -= inode->pages[i].sz;
+    }
+    free(inode->pages);
+    free(inode->ind_extents);
+    free(inode->dind_ptrs);
+    for (i = 0; inode->dblks != NULL && i < inode->blk_cnt; i++) {
+        free(inode->dblks[i].dx);
+    }
+    free(inode->dblks);
+    free(inode->dhash);
+    free(inode->neg);
+    free(inode->bloom);
+    newfs_meta_charge(inode, -inode->meta_bytes);
+}
+
+/**
+ * @brief 释放以dentry为根、已读入内存的子树中各inode挂着的缓冲区，卸载时用
+ * 
+ * @param dentry 
+ */
+static void newfs_release_tree(struct newfs_dentry* dentry) {
+    struct newfs_dentry* dentry_cursor;
+    if (dentry->inode == NULL) {
+        return;
+    }
+    for (dentry_cursor = dentry->inode->dentrys; dentry_cursor != NULL; dentry_cursor = dentry_cursor->brother) {
+        newfs_release_tree(dentry_cursor);
+    }
+    newfs_release_inode(dentry->inode);
+}
+
+/**
+ * @brief inode缓存大致占用的内存：inode、dentry、文件名、文件页，以及目录结构和extent映射
+ * 
+ * @return long 
+ */
+static long newfs_cache_mem() {
+    long mem = newfs_super.page_bytes + newfs_super.meta_bytes;
+    int  i;
+    mem += (long)newfs_super.inode_slab.live * newfs_super.inode_slab.obj_sz;
+    mem += (long)newfs_super.dentry_slab.live * newfs_super.dentry_slab.obj_sz;
+    for (i = 0; i < NEWFS_NAME_CLASSES; i++) {
+        mem += (long)newfs_super.name_slab[i].live * newfs_super.name_slab[i].obj_sz;
+    }
+    return mem;
+}
+
+/**
+ * @brief 把inode逐出内存，下次查找时重新读入
+ * 脏的先回写；目录连同其下的dentry一起释放，路径缓存中可能有指向它们的项，全部作废
+ * @param inode 必须在LRU链表上
+ * @return int 
+ */
+static int newfs_evict_inode(struct newfs_inode* inode) {
+    struct newfs_dentry* dentry = inode->dentry;
+    struct newfs_dentry* dentry_cursor;
+    struct newfs_dentry* next;
+
+    if (newfs_sync_inode(inode) != NEWFS_ERROR_NONE) {
+        NEWFS_DBG("[%s] io error\n", __func__);
+        return -NEWFS_ERROR_IO;
+    }
+    newfs_lru_del(inode);
+    if (NEWFS_IS_DIR(inode)) {
+        for (dentry_cursor = inode->dentrys; dentry_cursor != NULL; dentry_cursor = next) {
+            next = dentry_cursor->brother;
+            newfs_free_dentry(dentry_cursor);
+        }
+        newfs_pcache_flush();
+    }
+    newfs_release_inode(inode);
+    newfs_slab_free(&newfs_super.inode_slab, inode);
+    dentry->inode = NULL;
+    newfs_lru_unpin(dentry->parent->inode, TRUE);
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 占用超过上限时从LRU链表尾部淘汰，直到回到上限以内
+ * 本次和上一次路径查找用到的inode不淘汰，改名等一次操作查找两条路径时，先查到的仍然有效。
+ * 子inode淘汰后父目录挂回尾部时保留原来的lru_tick，链表并不严格按lru_tick排序，
+ * 所以遇到不能淘汰的项跳过它往前找，每淘汰一个再从尾部开始
+ */
+static void newfs_cache_shrink() {
+    struct newfs_inode* inode;
+    if (newfs_super.cache_limit == 0) {
+        return;
+    }
+    inode = newfs_super.lru_tail;
+    while (inode != NULL && newfs_cache_mem() > newfs_super.cache_limit) {
+        if (inode->lru_tick + 1 >= newfs_super.lru_tick) {
+            inode = inode->lru_prev;
+            continue;
+        }
+        if (newfs_evict_inode(inode) != NEWFS_ERROR_NONE) {
+            break;
+        }
+        inode = newfs_super.lru_tail;
+    }
+}
+
+/**
+ * @brief 取dentry的inode：不在内存时读入，在内存时移到LRU链表头部
+ * 
+ * @param dentry 
+ * @return struct newfs_inode* 
+ */
+static struct newfs_inode* newfs_get_inode(struct newfs_dentry* dentry) {
+    struct newfs_inode* inode = dentry->inode;
+    if (inode == NULL) {
+        dentry->inode = newfs_read_inode(dentry, dentry->ino);
+    }
+    else if (newfs_super.cache_limit > 0) {            /* 不在链表上的目录也记下，子inode淘汰后挂回尾部时仍算刚用过 */
+        newfs_lru_del(inode);
+        newfs_lru_add(inode, FALSE);
+        inode->lru_tick = newfs_super.lru_tick;
+    }
+    return dentry->inode;
+}
+
+/**
+ * @brief 
+ * 卸载函数
+ * @return int 
+ */
+int newfs_umount() {
+    struct newfs_super_d  newfs_super_d; 
+    int                   g;
+
+    if (!newfs_super.is_mounted) {
+        return NEWFS_ERROR_NONE;
+    }
+    // ①回写脏链表中的inode、目录项以及位图。
+    if (newfs_sync_dirty() != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+
+    // ②将内存超级块转换为磁盘超级块并写入磁盘。                                                
+    newfs_super_d.magic_num           = NEWFS_MAGIC;
+    // 转换inode位图
+    newfs_super_d.map_inode_blks      = newfs_super.map_inode_blks;
+    newfs_super_d.map_inode_offset    = newfs_super.map_inode_offset;
+    //转换data位图
+    newfs_super_d.map_data_blks      = newfs_super.map_data_blks;
+    newfs_super_d.map_data_offset    = newfs_super.map_data_offset;
+    //转换data数据块和inode索引节点
+    newfs_super_d.inode_offset         = newfs_super.inode_offset;
+    newfs_super_d.data_offset         = newfs_super.data_offset;
+
+    newfs_super_d.sz_usage            = newfs_super.sz_usage;
+    newfs_super_d.max_ino             = newfs_super.max_ino;
+    newfs_super_d.max_data            = newfs_super.max_data;
+    newfs_super_d.group_cnt           = newfs_super.group_cnt;
+    newfs_super_d.group_blks          = newfs_super.group_blks;
+    newfs_super_d.ino_per_group       = newfs_super.ino_per_group;
+    newfs_super_d.data_per_group      = newfs_super.data_per_group;
+
+    if (newfs_driver_write(NEWFS_SUPER_OFS, (uint8_t *)&newfs_super_d, 
+                     sizeof(struct newfs_super_d)) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+
+    // ③位图已在newfs_sync_dirty中按需写回。
+    newfs_bitmap_destroy(&newfs_super.bmap_inode);
+    newfs_bitmap_destroy(&newfs_super.bmap_data);
+    free(newfs_super.map_inode);
+    free(newfs_super.map_data);
+    free(newfs_super.map_inode_dirty);
+    free(newfs_super.map_data_dirty);
+    for (g = 0; g < newfs_super.group_cnt * NEWFS_ITABLE_BLKS(); g++) {
+        free(newfs_super.itable[g]);
+    }
+    free(newfs_super.itable);
+    free(newfs_super.itable_dirty);
+    free(newfs_super.itable_dirty_list);
+    for (g = 0; g < NEWFS_PCACHE_SZ; g++) {
+        free(newfs_super.pcache[g].path);
+    }
+    free(newfs_super.pcache);
+    // 内存中的目录树：先释放各inode挂着的缓冲区，dentry、inode和文件名本身随分配器整块释放
+    newfs_release_tree(newfs_super.root_dentry);
+    newfs_slab_destroy(&newfs_super.dentry_slab);
+    newfs_slab_destroy(&newfs_super.inode_slab);
+    newfs_name_destroy();
+
+    // ​ ④关闭驱动。
+    ddriver_close(NEWFS_DRIVER());
+
+    return NEWFS_ERROR_NONE;
+}
+
+/*****************************
+ * 创建目录和文件
+ * ****************************/
+
+/**
+ * @brief 完整路径的散列（与newfs_hash_name相同），顺带算出父目录路径的散列。
+ * 只缓存FUSE给出的规范路径：以'/'开头、没有空的路径分量、不以'/'结尾，
+ * 这样每个dentry只对应一个缓存槽，删除、改名时按路径就能准确作废
+ * @param path 
+ * @param hash 
+ * @param parent_hash 父目录路径的散列
+ * @param parent_len 父目录路径的长度，父目录为根时为0
+ * @return boolean 不是规范路径（含根目录）返回FALSE
+ */
+static boolean newfs_pcache_hash(const char* path, uint32_t* hash, uint32_t* parent_hash, int* parent_len) {
+    const char* pos;
+    uint32_t    h = 2166136261u;
+
+    if (path[0] != '/' || path[1] == '\0') {
+        return FALSE;
+    }
+    for (pos = path; *pos; pos++) {
+        if (*pos == '/') {
+            if (pos[1] == '/' || pos[1] == '\0') {
+                return FALSE;
+            }
+            *parent_hash = h;
+            *parent_len  = pos - path;
+        }
+        h = (h ^ (uint8_t)*pos) * 16777619u;
+    }
+    *hash = h;
+    return TRUE;
+}
+
+static struct newfs_pcache_ent* newfs_pcache_slot(uint32_t hash) {
+    return &newfs_super.pcache[hash & (NEWFS_PCACHE_SZ - 1)];
+}
+
+/**
+ * @brief 缓存项是否为path的前len个字符
+ * 
+ * @return boolean 
+ */
+static boolean newfs_pcache_match(struct newfs_pcache_ent* ent, const char* path, int len, uint32_t hash) {
+    return ent->gen == newfs_super.pcache_gen && ent->hash == hash && 
+           strncmp(ent->path, path, len) == 0 && ent->path[len] == '\0';
+}
+
+/**
+ * @brief 记入路径缓存，同槽的旧项被替换
+ * 
+ */
+static void newfs_pcache_put(const char* path, uint32_t hash, struct newfs_dentry* dentry) {
+    struct newfs_pcache_ent* ent = newfs_pcache_slot(hash);
+    ent->path   = (char *)realloc(ent->path, strlen(path) + 1);
+    strcpy(ent->path, path);
+    ent->hash   = hash;
+    ent->gen    = newfs_super.pcache_gen;
+    ent->dentry = dentry;
+}
+
+/**
+ * @brief 用路径缓存查找：完整路径命中直接返回；否则父目录路径命中时只在父目录中找最后一级，
+ * 找不到也能直接返回父目录，不存在的路径与存在的一样只需一次散列加一次目录内查找
+ * @param path 
+ * @param hash 
+ * @param parent_hash 
+ * @param parent_len 
+ * @param is_find 
+ * @return struct newfs_dentry* 两级都未命中或inode读不进来返回NULL，需要从根逐级查找
+ */
+static struct newfs_dentry* newfs_pcache_probe(const char* path, uint32_t hash, uint32_t parent_hash, 
+                                               int parent_len, boolean* is_find) {
+    struct newfs_pcache_ent* ent = newfs_pcache_slot(hash);
+    struct newfs_dentry*     parent;
+    struct newfs_dentry*     dentry;
+
+    if (newfs_pcache_match(ent, path, strlen(path), hash)) {     /* inode可能已被淘汰 */
+        if (newfs_get_inode(ent->dentry) == NULL) {
+            return NULL;
+        }
+        *is_find = TRUE;
+        return ent->dentry;
+    }
+    if (parent_len == 0) {
+        parent = newfs_super.root_dentry;
+    }
+    else {
+        ent = newfs_pcache_slot(parent_hash);
+        if (!newfs_pcache_match(ent, path, parent_len, parent_hash)) {
+            return NULL;
+        }
+        parent = ent->dentry;
+    }
+    if (newfs_get_inode(parent) == NULL || !NEWFS_IS_DIR(parent->inode)) {
+        return NULL;
+    }
+    dentry = newfs_find_dentry(parent->inode, path + parent_len + 1);
+    if (dentry == NULL) {
+        return parent;
+    }
+    if (newfs_get_inode(dentry) == NULL) {
+        return NULL;
+    }
+    newfs_pcache_put(path, hash, dentry);
+    *is_find = TRUE;
+    return dentry;
+}
+
+/**
+ * @brief 作废path的路径缓存项，删除、改名时调用
+ * 
+ * @param path 
+ */
+void newfs_pcache_drop(const char* path) {
+    struct newfs_pcache_ent* ent;
+    uint32_t hash, parent_hash;
+    int      parent_len;
+    if (!newfs_pcache_hash(path, &hash, &parent_hash, &parent_len)) {         /* 不规范的路径对应哪个缓存项不好说，全部作废 */
+        newfs_pcache_flush();
+        return;
+    }
+    ent = newfs_pcache_slot(hash);
+    if (ent->path != NULL && strcmp(ent->path, path) == 0) {
+        ent->gen    = 0;
+        ent->dentry = NULL;
+    }
+}
+
+/**
+ * @brief 作废全部路径缓存项，目录改名后其下所有路径都变了
+ * 
+ */
+void newfs_pcache_flush() {
+    newfs_super.pcache_gen++;
+}
+
+/**
+ * @brief 从路径中取出下一个分量，跳过多余的'/'，顺带算出分量的散列
+ * 只移动it中的指针，不分配内存也不改动路径，多个线程可以各自遍历
+ * @param it 先用newfs_path_init初始化
+ * @return boolean 没有分量了返回FALSE
+ */
+boolean newfs_path_next(struct newfs_path_iter* it) {
+    const char* pos = it->pos;
+    uint32_t    h   = 2166136261u;
+
+    while (*pos == '/') {
+        pos++;
+    }
+    if (*pos == '\0') {
+        it->pos = pos;
+        return FALSE;
+    }
+    it->name = pos;
+    while (*pos != '/' && *pos != '\0') {
+        h = (h ^ (uint8_t)*pos++) * 16777619u;
+    }
+    it->len  = pos - it->name;
+    it->hash = h;
+    while (*pos == '/') {
+        pos++;
+    }
+    it->pos = pos;
+    return TRUE;
+}
+
+void newfs_path_init(struct newfs_path_iter* it, const char* path) {
+    it->pos  = path;
+    it->name = path;
+    it->len  = 0;
+}
+
+/**
+ * 路径解析，得到父目录的dentry
+ * @brief 
+ * path: /qwe/ad
+ *      1) find /'s inode
+ *      2) find qwe's dentry 
+ *      3) find qwe's inode
+ *      4) find ad's dentry，ad是最后一级
+ *
+ * path: /qwe
+ *      1) find /'s inode
+ *      2) find qwe's dentry，qwe是最后一级
+ * 
+ * 一遍扫描路径，分量按长度和散列在目录中比较，不复制路径
+ * @param path 
+ * @return struct newfs_dentry* 路径上的inode读盘失败时返回NULL，is_find为FALSE
+ */
+struct newfs_dentry* newfs_lookup(const char * path, boolean* is_find, boolean* is_root) {
+    struct newfs_dentry*   dentry_cursor = newfs_super.root_dentry;//设置一个游标(dentry_cursor)指向根目录的dentry
+    struct newfs_dentry*   dentry_ret = NULL;
+    struct newfs_inode*    inode; 
+    struct newfs_path_iter it;
+    boolean  cacheable;
+    uint32_t hash, parent_hash;
+    int      parent_len;
+
+    *is_find = FALSE;
+    *is_root = FALSE;
+    // 新的一次查找，先把缓存收回到上限以内
+    newfs_super.lru_tick++;
+    newfs_cache_shrink();
+    // 先查路径缓存，命中时一次散列就得到dentry
+    cacheable = newfs_pcache_hash(path, &hash, &parent_hash, &parent_len);
+    if (cacheable) {
+        dentry_ret = newfs_pcache_probe(path, hash, parent_hash, parent_len, is_find);
+        if (dentry_ret != NULL) {
+            return dentry_ret;
+        }
+    }
+
+    newfs_path_init(&it, path);
+    //如果路径中没有分量，就是根目录，直接返回根目录的dentry
+    if (!newfs_path_next(&it)) {                    /* 根目录 */
+        *is_find = TRUE;
+        *is_root = TRUE;
+        dentry_ret = newfs_super.root_dentry;
+    }
+    while (dentry_ret == NULL) {
+        inode = newfs_get_inode(dentry_cursor);       /* Cache机制 */
+        if (inode == NULL) {
+            NEWFS_DBG("[%s] read inode %d failed\n", __func__, dentry_cursor->ino);
+            return NULL;
+        }
+        //还有下一级要找但当前不是目录，函数会直接返回该文件的dentry。
+        if (!NEWFS_IS_DIR(inode)) {
+            NEWFS_DBG("[%s] not a dir\n", __func__);
+            dentry_ret = inode->dentry;
+            break;
+        }
+        // 在该目录的散列表中查找路径中的下一级名字，平均O(1)。
+        dentry_cursor = newfs_find_name(inode, it.name, it.len, it.hash);
+        // 如果在当前目录下找不到匹配的dentry，则表示路径中的某一级目录不存在，此时函数会返回当前目录的dentry。
+        if (dentry_cursor == NULL) {
+            NEWFS_DBG("[%s] not found %.*s\n", __func__, it.len, it.name);
+            dentry_ret = inode->dentry;
+            break;
+        }
+        //如果找到了路径中的最后一级的dentry，则表示路径有效，函数会返回该dentry。
+        if (!newfs_path_next(&it)) {
+            *is_find = TRUE;
+            dentry_ret = dentry_cursor;
+        }
+    }
+    //最后，函数会确保返回的dentry中的inode已经被读取到内存中，并将其返回。
+    if (newfs_get_inode(dentry_ret) == NULL) {
+        *is_find = FALSE;
+        return NULL;
+    }
+    if (*is_find && cacheable) {
+        newfs_pcache_put(path, hash, dentry_ret);
+    }
+    
+    return dentry_ret;
+}
+
+/**
+ * @brief 在线性目录中找一个还能放下sz字节记录的块，先看最后一块，再从头找删除留下的空间
+ * 
+ * @param inode 
+ * @param sz 
+ * @return int 块号，都放不下返回-1
+ */
+static int newfs_dir_find_blk(struct newfs_inode* inode, int sz) {
+    int b;
+    if (inode->blk_cnt > 0 && inode->dblks[inode->blk_cnt - 1].used + sz <= NEWFS_BLK_SZ()) {
+        return inode->blk_cnt - 1;
+    }
+    for (b = 0; b < inode->blk_cnt; b++) {
+        if (inode->dblks[b].used + sz <= NEWFS_BLK_SZ()) {
+            return b;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 目录再分配cnt个块，新块为空、已读入、脏（即使没放记录也要写一次，清掉块里的旧内容）
+ * 
+ * @param inode 
+ * @param cnt 
+ * @return int 第一个新块的块号，失败返回负的错误码
+ */
+static int newfs_dir_grow(struct newfs_inode* inode, int cnt) {
+    int old_cnt = inode->blk_cnt, ret, b;
+
+    ret = newfs_alloc_data(inode, old_cnt + cnt);
+    if (inode->blk_cnt > old_cnt) {                    /* 中途失败时已分配的块也要记下 */
+        inode->dblks = (struct newfs_dir_blk *)realloc(inode->dblks, inode->blk_cnt * sizeof(struct newfs_dir_blk));
+        newfs_meta_charge(inode, (inode->blk_cnt - old_cnt) * sizeof(struct newfs_dir_blk));
+        for (b = old_cnt; b < inode->blk_cnt; b++) {
+            memset(&inode->dblks[b], 0, sizeof(struct newfs_dir_blk));
+            inode->dblks[b].loaded = TRUE;
+            inode->dblks[b].dirty  = TRUE;
+        }
+    }
+    return ret != NEWFS_ERROR_NONE ? ret : old_cnt;
+}
+
+/**
+ * @brief 按字节比较名字a与长为blen的键b
+ * 
+ * @return int 
+ */
+static int newfs_bt_cmp(const char* a, int alen, const char* b, int blen) {
+    int ret = memcmp(a, b, alen < blen ? alen : blen);
+    return ret != 0 ? ret : alen - blen;
+}
+
+/* 散列相同时再按文件名，同散列的名字顺序固定，readdir续读位置才能数清已读过几个 */
+static int newfs_dx_cmp(const void* a, const void* b) {
+    uint32_t ha = ((const struct newfs_dx_sort *)a)->hash;
+    uint32_t hb = ((const struct newfs_dx_sort *)b)->hash;
+    if (ha != hb) {
+        return ha < hb ? -1 : 1;
+    }
+    return strcmp(((const struct newfs_dx_sort *)a)->dentry->fname, ((const struct newfs_dx_sort *)b)->dentry->fname);
+}
+
+static int newfs_bt_cmp_sort(const void* a, const void* b) {
+    return strcmp(((const struct newfs_dx_sort *)a)->dentry->fname, ((const struct newfs_dx_sort *)b)->dentry->fname);
+}
+
+static void newfs_dx_make_key(const char* fname, struct newfs_dx_key* key) {
+    key->hash = newfs_hash_name(fname);
+    key->name = fname;
+    key->len  = strlen(fname);
+}
+
+/**
+ * @brief 把dentry链表按索引键排序：有序目录按文件名，否则按文件名散列
+ * 
+ * @param inode 
+ * @param dentry_cursor 链表头
+ * @param next_of_blk TRUE沿blk_next走，FALSE沿brother走
+ * @param n 返回项数
+ * @return struct newfs_dx_sort* 
+ */
+static struct newfs_dx_sort* newfs_dx_sort(struct newfs_inode* inode, struct newfs_dentry* dentry_cursor, 
+                                           boolean next_of_blk, int* n) {
+    struct newfs_dx_sort* ents = NULL;
+    int cap = 0;
+
+    *n = 0;
+    while (dentry_cursor != NULL) {
+        if (*n == cap) {
+            cap  = cap == 0 ? 64 : cap * 2;
+            ents = (struct newfs_dx_sort *)realloc(ents, cap * sizeof(struct newfs_dx_sort));
+        }
+        ents[*n].hash   = dentry_cursor->hash;
+        ents[*n].dentry = dentry_cursor;
+        (*n)++;
+        dentry_cursor = next_of_blk ? dentry_cursor->blk_next : dentry_cursor->brother;
+    }
+    qsort(ents, *n, sizeof(struct newfs_dx_sort), NEWFS_IS_SORTED(inode) ? newfs_bt_cmp_sort : newfs_dx_cmp);
+    return ents;
+}
+
+/**
+ * @brief 相邻两块之间的分隔键：右块的第一个键。有序目录取右块第一个名字中刚好大于左块最后一个名字的最短前缀
+ * 
+ * @param inode 
+ * @param left 左块最后一项
+ * @param right 右块第一项
+ * @param key 
+ */
+static void newfs_dx_sep(struct newfs_inode* inode, struct newfs_dx_sort* left, struct newfs_dx_sort* right, 
+                         struct newfs_dx_key* key) {
+    const char* l = left->dentry->fname;
+    const char* r = right->dentry->fname;
+    int len = 0;
+
+    key->hash = right->hash;
+    key->name = r;
+    if (NEWFS_IS_SORTED(inode)) {
+        while (l[len] == r[len]) {
+            len++;
+        }
+        key->len = len + 1;
+    }
+    else {
+        key->len = strlen(r);
+    }
+}
+
+/**
+ * @brief B+树索引块中的第i项，键是变长的，只能从头数
+ * 
+ * @param node 
+ * @param i 
+ * @return struct newfs_bt_key_d* 
+ */
+static struct newfs_bt_key_d* newfs_bt_key(struct newfs_bt_node_d* node, int i) {
+    uint8_t* pos = node->keys;
+    while (i-- > 0) {
+        pos += NEWFS_BT_KEY_SZ(((struct newfs_bt_key_d *)pos)->len);
+    }
+    return (struct newfs_bt_key_d *)pos;
+}
+
+/**
+ * @brief 索引块中key所属的项：最后一个起始键不大于key的项，第0项视作最小
+ * 
+ * @param inode 
+ * @param node 
+ * @param key 
+ * @return int 
+ */
+static int newfs_dx_search(struct newfs_inode* inode, uint8_t* node, struct newfs_dx_key* key) {
+    struct newfs_dx_node_d* dx = (struct newfs_dx_node_d *)node;
+    struct newfs_bt_key_d*  bt_key;
+    int lo = 1, hi = dx->count - 1, mid, ret = 0;
+
+    if (NEWFS_IS_SORTED(inode)) {
+        bt_key = (struct newfs_bt_key_d *)((struct newfs_bt_node_d *)node)->keys;
+        for (mid = 1; mid < dx->count; mid++) {
+            bt_key = (struct newfs_bt_key_d *)((uint8_t *)bt_key + NEWFS_BT_KEY_SZ(bt_key->len));
+            if (newfs_bt_cmp(key->name, key->len, bt_key->key, bt_key->len) < 0) {
+                break;
+            }
+            ret = mid;
+        }
+        return ret;
+    }
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (dx->entries[mid].hash <= key->hash) {
+            ret = mid;
+            lo  = mid + 1;
+        }
+        else {
+            hi  = mid - 1;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief 索引块第i项指向的块号
+ * 
+ * @return int 
+ */
+static int newfs_dx_child(struct newfs_inode* inode, uint8_t* node, int i) {
+    if (NEWFS_IS_SORTED(inode)) {
+        return newfs_bt_key((struct newfs_bt_node_d *)node, i)->blk;
+    }
+    return ((struct newfs_dx_node_d *)node)->entries[i].blk;
+}
+
+/**
+ * @brief 索引块第i项的键，B+树的键指向索引块内部
+ * 
+ * @return int 
+ */
+static void newfs_dx_entry_key(struct newfs_inode* inode, uint8_t* node, int i, struct newfs_dx_key* key) {
+    struct newfs_bt_key_d* bt_key;
+    if (NEWFS_IS_SORTED(inode)) {
+        bt_key    = newfs_bt_key((struct newfs_bt_node_d *)node, i);
+        key->name = bt_key->key;
+        key->len  = bt_key->len;
+    }
+    else {
+        key->hash = ((struct newfs_dx_node_d *)node)->entries[i].hash;
+    }
+}
+
+/**
+ * @brief 索引块是否可能放不下再一项，B+树按最长的键算
+ * 
+ * @return boolean 
+ */
+static boolean newfs_dx_full(struct newfs_inode* inode, uint8_t* node) {
+    if (NEWFS_IS_SORTED(inode)) {
+        return ((struct newfs_bt_node_d *)node)->used + NEWFS_BT_KEY_SZ(NEWFS_MAX_FILE_NAME) > NEWFS_BT_CAP();
+    }
+    return ((struct newfs_dx_node_d *)node)->count >= NEWFS_DX_LIMIT();
+}
+
+/**
+ * @brief 在索引块第pos项处插入(key, blk)
+ * 
+ * @param inode 
+ * @param node 
+ * @param pos 
+ * @param key 
+ * @param blk 
+ */
+static void newfs_dx_put(struct newfs_inode* inode, uint8_t* node, int pos, struct newfs_dx_key* key, int blk) {
+    struct newfs_dx_node_d* dx = (struct newfs_dx_node_d *)node;
+    struct newfs_bt_node_d* bt = (struct newfs_bt_node_d *)node;
+    struct newfs_bt_key_d*  bt_key;
+    int sz;
+
+    if (NEWFS_IS_SORTED(inode)) {
+        bt_key = newfs_bt_key(bt, pos);
+        sz     = NEWFS_BT_KEY_SZ(key->len);
+        memmove((uint8_t *)bt_key + sz, bt_key, bt->used - ((uint8_t *)bt_key - bt->keys));
+        bt_key->blk = blk;
+        bt_key->len = key->len;
+        memcpy(bt_key->key, key->name, key->len);
+        bt->used   += sz;
+    }
+    else {
+        memmove(dx->entries + pos + 1, dx->entries + pos, (dx->count - pos) * sizeof(struct newfs_dx_entry_d));
+        dx->entries[pos].hash = key->hash;
+        dx->entries[pos].blk  = blk;
+    }
+    dx->count++;
+}
+
+/**
+ * @brief 把索引块的后一半项搬到空块sib
+ * 
+ * @param inode 
+ * @param node 
+ * @param sib 
+ * @return int node留下的项数
+ */
+static int newfs_dx_halve(struct newfs_inode* inode, uint8_t* node, uint8_t* sib) {
+    struct newfs_dx_node_d* dx     = (struct newfs_dx_node_d *)node;
+    struct newfs_dx_node_d* dx_sib = (struct newfs_dx_node_d *)sib;
+    struct newfs_bt_node_d* bt     = (struct newfs_bt_node_d *)node;
+    struct newfs_bt_node_d* bt_sib = (struct newfs_bt_node_d *)sib;
+    int half = 0, pos = 0;
+
+    dx_sib->levels = dx->levels;
+    if (NEWFS_IS_SORTED(inode)) {                      /* 按字节对半分 */
+        while (half < dx->count - 1 && (pos < bt->used / 2 || half == 0)) {
+            pos += NEWFS_BT_KEY_SZ(((struct newfs_bt_key_d *)(bt->keys + pos))->len);
+            half++;
+        }
+        bt_sib->used = bt->used - pos;
+        memcpy(bt_sib->keys, bt->keys + pos, bt_sib->used);
+        bt->used     = pos;
+    }
+    else {
+        half = dx->count / 2;
+        memcpy(dx_sib->entries, dx->entries + half, (dx->count - half) * sizeof(struct newfs_dx_entry_d));
+    }
+    dx_sib->count = dx->count - half;
+    dx->count     = half;
+    return half;
+}
+
+/**
+ * @brief 把索引块清空为只有一项的块，该项覆盖全部键
+ * 
+ * @param inode 
+ * @param node 
+ * @param levels 
+ * @param blk 
+ */
+static void newfs_dx_init_root(struct newfs_inode* inode, uint8_t* node, int levels, int blk) {
+    struct newfs_dx_key key = { 0, "", 0 };
+    memset(node, 0, NEWFS_BLK_SZ());
+    ((struct newfs_dx_node_d *)node)->levels = levels;
+    newfs_dx_put(inode, node, 0, &key, blk);
+}
+
+/**
+ * @brief 从根索引块逐层找到key所在的叶子块，途经的索引块按需读入
+ * 
+ * @param inode 
+ * @param key 
+ * @param path 可为NULL，返回途经的索引块号，path[0]为根
+ * @param idx 可为NULL，返回在各索引块中选中的项
+ * @param depth 可为NULL，返回途经的索引块数
+ * @return int 叶子块号，读盘失败返回负数
+ */
+static int newfs_dx_leaf(struct newfs_inode* inode, struct newfs_dx_key* key, int* path, int* idx, int* depth) {
+    struct newfs_dx_node_d* node;
+    int b = 0, lvl = 0, i;
+
+    while (TRUE) {
+        if (newfs_dir_load_blk(inode, b, TRUE) != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_IO;
+        }
+        node = (struct newfs_dx_node_d *)inode->dblks[b].dx;
+        i    = newfs_dx_search(inode, inode->dblks[b].dx, key);
+        if (path != NULL) {
+            path[lvl] = b;
+            idx[lvl]  = i;
+        }
+        lvl++;
+        b = newfs_dx_child(inode, inode->dblks[b].dx, i);
+        if (node->levels == 0) {
+            break;
+        }
+    }
+    if (depth != NULL) {
+        *depth = lvl;
+    }
+    return b;
+}
+
+/**
+ * @brief 读入以第b块为根的整棵索引子树及其叶子块，遍历目录时用
+ * 
+ * @param inode 
+ * @param b 
+ * @param image 目录全部块的映像，NULL时逐块读盘
+ * @return int 
+ */
+static int newfs_dx_load_all(struct newfs_inode* inode, int b, const uint8_t* image) {
+    struct newfs_dx_node_d* node;
+    int i, ret, child;
+
+    if (newfs_dir_load_blk_from(inode, b, TRUE, image) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+    node = (struct newfs_dx_node_d *)inode->dblks[b].dx;
+    for (i = 0; i < node->count; i++) {
+        child = newfs_dx_child(inode, inode->dblks[b].dx, i);
+        ret   = node->levels > 0 ? newfs_dx_load_all(inode, child, image) 
+                                 : newfs_dir_load_blk_from(inode, child, FALSE, image);
+        if (ret != NEWFS_ERROR_NONE) {
+            return ret;
+        }
+    }
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 在path[lvl]索引块中idx[lvl]项之后插入(key, blk)
+ * 索引块满了就对半分，新块插入上一层；根满了则把根的内容搬到一个新块，树长高一层。
+ * 需要的新块已由调用者分配好，从*spare开始依次取用
+ * @return int 
+ */
+static int newfs_dx_insert(struct newfs_inode* inode, int* path, int* idx, int lvl, 
+                           struct newfs_dx_key* key, int blk, int* spare) {
+    uint8_t* node = inode->dblks[path[lvl]].dx;
+    uint8_t* sib;
+    struct newfs_dx_key sep;
+    int pos = idx[lvl] + 1, half, b, k;
+
+    if (newfs_dx_full(inode, node) && lvl == 0) {
+        b = (*spare)++;
+        inode->dblks[b].dx = (uint8_t *)malloc(NEWFS_BLK_SZ());
+        newfs_meta_charge(inode, NEWFS_BLK_SZ());
+        memcpy(inode->dblks[b].dx, node, NEWFS_BLK_SZ());
+        newfs_dx_init_root(inode, node, ((struct newfs_dx_node_d *)node)->levels + 1, b);
+        inode->dblks[path[0]].dirty = TRUE;
+        for (k = NEWFS_DX_MAX_LEVELS + 1; k > 0; k--) {
+            path[k] = path[k - 1];
+            idx[k]  = idx[k - 1];
+        }
+        path[1] = b;
+        idx[0]  = 0;
+        return newfs_dx_insert(inode, path, idx, 1, key, blk, spare);
+    }
+
+    if (newfs_dx_full(inode, node)) {
+        b    = (*spare)++;
+        inode->dblks[b].dx = (uint8_t *)calloc(1, NEWFS_BLK_SZ());
+        newfs_meta_charge(inode, NEWFS_BLK_SZ());
+        sib  = inode->dblks[b].dx;
+        half = newfs_dx_halve(inode, node, sib);
+        inode->dblks[path[lvl]].dirty = TRUE;
+        if (pos >= half) {
+            node = sib;
+            pos -= half;
+        }
+        newfs_dx_put(inode, node, pos, key, blk);
+        newfs_dx_entry_key(inode, sib, 0, &sep);
+        return newfs_dx_insert(inode, path, idx, lvl - 1, &sep, b, spare);
+    }
+
+    newfs_dx_put(inode, node, pos, key, blk);
+    inode->dblks[path[lvl]].dirty = TRUE;
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 叶子块放不下时对半分裂，键较大的一半搬到新块，分隔键插入父索引块
+ * 散列索引中散列相同的记录总在同一块中
+ * @param inode 
+ * @param leaf 
+ * @param path newfs_dx_leaf返回的路径
+ * @param idx 
+ * @param depth 
+ * @return int 
+ */
+static int newfs_dx_split_leaf(struct newfs_inode* inode, int leaf, int* path, int* idx, int depth) {
+    struct newfs_dx_sort* ents;
+    struct newfs_dx_key   sep;
+    int n, m, lvl, need = 1, spare, ret, i;
+
+    /* 先算好一共要几个新块：新叶子块，加上沿路径向上每个已满的索引块 */
+    for (lvl = depth - 1; lvl >= 0 && newfs_dx_full(inode, inode->dblks[path[lvl]].dx); lvl--) {
+        need++;
+        if (lvl == 0) {
+            if (((struct newfs_dx_node_d *)inode->dblks[0].dx)->levels >= NEWFS_DX_MAX_LEVELS) {
+                return -NEWFS_ERROR_NOSPACE;
+            }
+            need++;
+        }
+    }
+
+    ents = newfs_dx_sort(inode, inode->dblks[leaf].dentrys, TRUE, &n);
+    m    = n / 2;
+    while (!NEWFS_IS_SORTED(inode) && m < n && ents[m].hash == ents[m - 1].hash) {
+        m++;
+    }
+    if (m == n) {
+        m = n / 2;
+        while (m > 0 && ents[m].hash == ents[m - 1].hash) {
+            m--;
+        }
+    }
+    if (m == 0) {                                      /* 整块都是同一个散列值，无法再分 */
+        free(ents);
+        return -NEWFS_ERROR_NOSPACE;
+    }
+
+    spare = newfs_dir_grow(inode, need);
+    if (spare < 0) {
+        free(ents);
+        return spare;
+    }
+    for (i = m; i < n; i++) {
+        newfs_dir_unchain(inode, ents[i].dentry);
+        newfs_dir_chain(inode, ents[i].dentry, spare);
+    }
+    newfs_dx_sep(inode, &ents[m - 1], &ents[m], &sep);
+    i   = spare + 1;
+    ret = newfs_dx_insert(inode, path, idx, depth - 1, &sep, spare, &i);
+    free(ents);
+    newfs_mark_inode_dirty(inode, NEWFS_FLAG_DIRTY);
+    return ret;
+}
+
+/**
+ * @brief 线性目录放满后转为带索引的目录
+ * 全部目录项按键排序后依次装满叶子块，第0块改作根索引块；
+ * 叶子块多于根能放下的项数时，逐层往上建中间索引块。所有块号事先算好，分配失败时目录保持原样
+ * @param inode 
+ * @return int 
+ */
+static int newfs_dx_convert(struct newfs_inode* inode) {
+    struct newfs_dx_sort* ents;
+    struct newfs_dx_key*  keys;                        /* 当前一层各块的起始键 */
+    int*                  blks;                        /* 及块号 */
+    uint8_t**             nodes = NULL;                /* 中间索引块 */
+    uint8_t*              root  = NULL;
+    int n, leaves = 1, used = 0, first = 0, cnt, nodes_cnt = 0, b, i, j, k, sz, ret = NEWFS_ERROR_NONE;
+
+    ents = newfs_dx_sort(inode, inode->dentrys, FALSE, &n);
+    keys = (struct newfs_dx_key *)calloc(n + 1, sizeof(struct newfs_dx_key));
+    blks = (int *)malloc((n + 1) * sizeof(int));
+    keys[0].name = "";
+    blks[0]      = 1;
+    for (i = 0; i < n; i++) {
+        sz = NEWFS_DENTRY_SZ(ents[i].dentry->name_len);
+        if (used + sz > NEWFS_BLK_SZ()) {
+            j = i;                                     /* 散列相同的记录要放在同一块 */
+            while (!NEWFS_IS_SORTED(inode) && j > first && ents[j].hash == ents[j - 1].hash) {
+                j--;
+            }
+            if (j == first) {
+                ret = -NEWFS_ERROR_NOSPACE;
+                goto out;
+            }
+            for (used = 0, k = j; k < i; k++) {
+                ents[k].blk = leaves + 1;
+                used += NEWFS_DENTRY_SZ(ents[k].dentry->name_len);
+            }
+            newfs_dx_sep(inode, &ents[j - 1], &ents[j], &keys[leaves]);
+            blks[leaves] = leaves + 1;
+            leaves++;
+            first = j;
+        }
+        used       += sz;
+        ents[i].blk = leaves;
+    }
+
+    b    = 1 + leaves;
+    cnt  = leaves;
+    root = (uint8_t *)malloc(NEWFS_BLK_SZ());
+    for (k = 0; ; k++) {
+        memset(root, 0, NEWFS_BLK_SZ());
+        ((struct newfs_dx_node_d *)root)->levels = k;
+        for (i = 0; i < cnt && !newfs_dx_full(inode, root); i++) {
+            newfs_dx_put(inode, root, i, &keys[i], blks[i]);
+        }
+        if (i == cnt) {
+            break;
+        }
+        if (k == NEWFS_DX_MAX_LEVELS) {
+            ret = -NEWFS_ERROR_NOSPACE;
+            goto out;
+        }
+        for (i = 0, j = 0; i < cnt; i++) {             /* 装不进根，这一层装进若干个中间索引块 */
+            if (j == 0 || newfs_dx_full(inode, nodes[nodes_cnt - 1])) {
+                nodes = (uint8_t **)realloc(nodes, (nodes_cnt + 1) * sizeof(uint8_t *));
+                nodes[nodes_cnt] = (uint8_t *)calloc(1, NEWFS_BLK_SZ());
+                ((struct newfs_dx_node_d *)nodes[nodes_cnt])->levels = k;
+                nodes_cnt++;
+                keys[j] = keys[i];
+                blks[j] = b++;
+                j++;
+            }
+            newfs_dx_put(inode, nodes[nodes_cnt - 1], ((struct newfs_dx_node_d *)nodes[nodes_cnt - 1])->count, 
+                         &keys[i], blks[i]);
+        }
+        cnt = j;
+    }
+
+    if (b > inode->blk_cnt) {
+        ret = newfs_dir_grow(inode, b - inode->blk_cnt);
+        if (ret < 0) {
+            goto out;
+        }
+        ret = NEWFS_ERROR_NONE;
+    }
+    for (i = 0; i < inode->blk_cnt; i++) {             /* 所有块重新排布 */
+        memset(&inode->dblks[i], 0, sizeof(struct newfs_dir_blk));
+        inode->dblks[i].loaded = TRUE;
+        inode->dblks[i].dirty  = TRUE;
+    }
+    for (i = 0; i < n; i++) {
+        newfs_dir_chain(inode, ents[i].dentry, ents[i].blk);
+    }
+    for (i = 0; i < nodes_cnt; i++) {
+        inode->dblks[1 + leaves + i].dx = nodes[i];
+    }
+    inode->dblks[0].dx = root;
+    newfs_meta_charge(inode, (nodes_cnt + 1) * NEWFS_BLK_SZ());
+    root      = NULL;
+    nodes_cnt = 0;
+    inode->iflags |= NEWFS_INODE_INDEX;
+    newfs_mark_inode_dirty(inode, NEWFS_FLAG_DIRTY);
+out:
+    for (i = 0; i < nodes_cnt; i++) {
+        free(nodes[i]);
+    }
+    free(nodes);
+    free(root);
+    free(ents);
+    free(keys);
+    free(blks);
+    return ret;
+}
+
+/**
+ * @brief 在目录中按名字查找dentry，平均O(1)，名字不必以'\0'结尾，路径分量可以直接传进来
+ * 先查目录记下的不存在的名字和Bloom过滤器，能确定不存在时直接返回；
+ * 带索引的目录再沿索引读入该名字所在的叶子块，冷查找只读索引路径上的几个块。
+ * 桶内先比较散列和长度，都相同时才比较名字
+ * @param inode 
+ * @param name 
+ * @param len 
+ * @param hash name的散列，同newfs_hash_name
+ * @return struct newfs_dentry* 找不到返回NULL
+ */
+struct newfs_dentry* newfs_find_name(struct newfs_inode* inode, const char* name, int len, uint32_t hash) {
+    struct newfs_dentry* dentry_cursor;
+    struct newfs_dx_key  key;
+    int b;
+
+    if (len >= NEWFS_MAX_FILE_NAME) {
+        return NULL;
+    }
+    key.hash = hash;
+    key.name = name;
+    key.len  = len;
+    if (newfs_neg_test(inode, name, len, hash)) {
+        return NULL;
+    }
+    /* 目录项全部在内存中时才能建Bloom过滤器，之后加入的名字随时记入 */
+    if (newfs_super.dir_bloom && inode->dir_cnt >= NEWFS_BLOOM_MIN && inode->dhash_cnt == inode->dir_cnt &&
+        (inode->bloom == NULL || inode->bloom_cnt > inode->bloom_bits / NEWFS_BLOOM_BITS_PER_NAME)) {
+        newfs_bloom_build(inode);
+    }
+    if (inode->bloom != NULL && !newfs_bloom_test(inode, hash)) {
+        return NULL;
+    }
+    if (NEWFS_IS_INDEXED(inode)) {
+        b = newfs_dx_leaf(inode, &key, NULL, NULL, NULL);
+        if (b < 0 || newfs_dir_load_blk(inode, b, FALSE) != NEWFS_ERROR_NONE) {
+            NEWFS_DBG("[%s] io error\n", __func__);
+            return NULL;
+        }
+    }
+    dentry_cursor = inode->dhash_sz == 0 ? NULL : inode->dhash[hash & (inode->dhash_sz - 1)];
+    while (dentry_cursor && (dentry_cursor->hash != hash || dentry_cursor->name_len != len || 
+                             memcmp(dentry_cursor->fname, name, len) != 0)) {
+        dentry_cursor = dentry_cursor->hash_next;
+    }
+    if (dentry_cursor == NULL) {
+        newfs_neg_add(inode, name, len, hash);
+    }
+    return dentry_cursor;
+}
+
+/**
+ * @brief 在目录中按文件名查找dentry
+ * 
+ * @param inode 
+ * @param fname 
+ * @return struct newfs_dentry* 找不到返回NULL
+ */
+struct newfs_dentry* newfs_find_dentry(struct newfs_inode* inode, const char* fname) {
+    return newfs_find_name(inode, fname, strlen(fname), newfs_hash_name(fname));
+}
+
+/**
+ * @brief 链表中大于（incl时不小于）after的最小名字
+ * 
+ * @return struct newfs_dentry* 
+ */
+static struct newfs_dentry* newfs_dir_min(struct newfs_dentry* dentry_cursor, boolean next_of_blk, 
+                                          const char* after, boolean incl) {
+    struct newfs_dentry* min = NULL;
+    int cmp;
+    while (dentry_cursor != NULL) {
+        cmp = strcmp(dentry_cursor->fname, after);
+        if ((cmp > 0 || (incl && cmp == 0)) && (min == NULL || strcmp(dentry_cursor->fname, min->fname) < 0)) {
+            min = dentry_cursor;
+        }
+        dentry_cursor = next_of_blk ? dentry_cursor->blk_next : dentry_cursor->brother;
+    }
+    return min;
+}
+
+/**
+ * @brief 沿newfs_dx_leaf记下的索引路径转到右边下一个叶子块，路径随之更新
+ * 往上找到还有右兄弟的一层，再沿最左边下到叶子块，只读入用到的索引块
+ * @param inode 
+ * @param path 
+ * @param idx 
+ * @param depth 
+ * @return int 叶子块号，已是最后一个叶子块返回-1，出错返回-NEWFS_ERROR_IO
+ */
+static int newfs_dx_next_leaf(struct newfs_inode* inode, int* path, int* idx, int depth) {
+    int b, lvl;
+    for (lvl = depth - 1; 
+         lvl >= 0 && idx[lvl] + 1 >= ((struct newfs_dx_node_d *)inode->dblks[path[lvl]].dx)->count; lvl--);
+    if (lvl < 0) {
+        return -1;
+    }
+    idx[lvl]++;
+    b = newfs_dx_child(inode, inode->dblks[path[lvl]].dx, idx[lvl]);
+    for (lvl++; lvl < depth && b >= 0; lvl++) {
+        if (newfs_dir_load_blk(inode, b, TRUE) != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_IO;
+        }
+        path[lvl] = b;
+        idx[lvl]  = 0;
+        b = newfs_dx_child(inode, inode->dblks[b].dx, 0);
+    }
+    return b;
+}
+
+/**
+ * @brief 有序目录中按字典序排在after之后的第一个目录项
+ * 带索引的目录从after所在的叶子块开始找，本块没有就沿索引转到下一个叶子块，只读入用到的块
+ * @param inode 
+ * @param after 空串表示从头开始
+ * @param incl TRUE时名字等于after也算
+ * @return struct newfs_dentry* 没有了返回NULL
+ */
+struct newfs_dentry* newfs_dir_next(struct newfs_inode* inode, const char* after, boolean incl) {
+    struct newfs_dentry* dentry;
+    struct newfs_dx_key  key;
+    int path[NEWFS_DX_MAX_LEVELS + 2], idx[NEWFS_DX_MAX_LEVELS + 2];
+    int depth, b;
+
+    if (!NEWFS_IS_INDEXED(inode)) {
+        return newfs_dir_min(inode->dentrys, FALSE, after, incl);
+    }
+    newfs_dx_make_key(after, &key);
+    b = newfs_dx_leaf(inode, &key, path, idx, &depth);
+    while (b >= 0) {
+        if (newfs_dir_load_blk(inode, b, FALSE) != NEWFS_ERROR_NONE) {
+            break;
+        }
+        dentry = newfs_dir_min(inode->dblks[b].dentrys, TRUE, after, incl);
+        if (dentry != NULL) {
+            return dentry;
+        }
+        b = newfs_dx_next_leaf(inode, path, idx, depth);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 按续读位置遍历无序目录，每项回调一次，回调返回非0时停止（有序目录用newfs_dir_next）
+ * 按(散列, 文件名)的顺序遍历，续读位置是NEWFS_COOKIE(散列, 同散列中已读过的个数)，与目录项的存放位置无关，
+ * 遍历期间新建、删除散列不同的目录项不会让已读过的项重复出现，也不会漏掉没删的项；
+ * 同散列的名字只按个数续读，续读位置所在散列中排在前面的名字被删掉会漏读一项，新建排在前面的名字会重读一项。
+ * 带索引的目录从位置所在的叶子块开始，每次只读入、排序一个叶子块
+ * @param inode 
+ * @param pos 0表示从头开始，否则是回调拿到的某个next
+ * @param emit 
+ * @param ctx 原样传给emit
+ * @return int 
+ */
+int newfs_dir_iterate(struct newfs_inode* inode, off_t pos, newfs_dir_emit_t emit, void* ctx) {
+    struct newfs_dx_sort* ents;
+    struct newfs_dx_key   key;
+    uint32_t hash = NEWFS_COOKIE_HASH(pos);
+    int      skip = NEWFS_COOKIE_SEQ(pos);
+    int path[NEWFS_DX_MAX_LEVELS + 2], idx[NEWFS_DX_MAX_LEVELS + 2];
+    int depth, b, n, i, seq;
+    boolean stop = FALSE;
+
+    if (NEWFS_IS_INDEXED(inode)) {
+        key.hash = hash;
+        key.name = "";
+        key.len  = 0;
+        b = newfs_dx_leaf(inode, &key, path, idx, &depth);
+        if (b < 0) {
+            return b;
+        }
     }
     else {
-        dentry->brother = inode->dentrys;
-        inode->dentrys = dentry;
+        b = -1;
+    }
+    do {
+        if (b >= 0 && newfs_dir_load_blk(inode, b, FALSE) != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_IO;
+        }
+        /* 散列索引中散列相同的记录总在同一块中，序号在块内数就够了 */
+        ents = newfs_dx_sort(inode, b >= 0 ? inode->dblks[b].dentrys : inode->dentrys, b >= 0, &n);
+        for (i = 0, seq = 0; i < n && !stop; i++) {
+            seq = i > 0 && ents[i].hash == ents[i - 1].hash ? seq + 1 : 0;
+            if (ents[i].hash < hash || (ents[i].hash == hash && seq < skip)) {
+                continue;
+            }
+            stop = emit(ctx, ents[i].dentry, NEWFS_COOKIE(ents[i].hash, seq + 1)) != 0;
+        }
+        free(ents);
+    } while (!stop && b >= 0 && (b = newfs_dx_next_leaf(inode, path, idx, depth)) >= 0);
+    return b < -1 ? b : NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief readdir从头列目录时调用，为接下来对每个子项的getattr预读：
+ * 带索引的目录还有块没读入时，按extent整段读出全部目录块再建目录项，不再沿索引逐块读；
+ * 然后把所有子项的inode表块按块号排好序批量读进缓存
+ * @param inode 目录inode
+ * @return int 
+ */
+int newfs_dir_prefetch(struct newfs_inode* inode) {
+    struct newfs_dentry* dentry_cursor;
+    uint8_t* image;
+    int*     inos;
+    int      n = 0, b, ret = NEWFS_ERROR_NONE;
+
+    if (NEWFS_IS_INDEXED(inode)) {
+        for (b = 0; b < inode->blk_cnt && inode->dblks[b].loaded; b++);
+        if (b < inode->blk_cnt) {
+            image = (uint8_t *)malloc(NEWFS_BLKS_SZ(inode->blk_cnt));
+            ret   = newfs_inode_io(inode, 0, image, inode->blk_cnt, FALSE);
+            if (ret == NEWFS_ERROR_NONE) {
+                ret = newfs_dx_load_all(inode, 0, image);
+            }
+            free(image);
+            if (ret != NEWFS_ERROR_NONE) {
+                return ret;
+            }
+        }
+    }
+    inos = (int *)malloc((inode->dir_cnt + 1) * sizeof(int));
+    for (dentry_cursor = inode->dentrys; dentry_cursor != NULL && n < inode->dir_cnt; 
+         dentry_cursor = dentry_cursor->brother) {
+        if (dentry_cursor->inode == NULL) {
+            inos[n++] = dentry_cursor->ino;
+        }
+    }
+    ret = newfs_itable_prefetch(inos, n);
+    free(inos);
+    return ret;
+}
+
+/**
+ * @brief 创建目录项
+ * 
+ * @param fname 
+ * @param ftype 
+ * @return struct newfs_dentry* 
+ */
+struct newfs_dentry* new_dentry(char * fname, NEWFS_FILE_TYPE ftype) {
+    return newfs_new_dentry_name(fname, strlen(fname), ftype);
+}
+
+/**
+ * @brief 给目录项换名字，旧名字归还文件名区，长度、散列随之更新
+ * 
+ * @param dentry 不能挂在目录的散列表中
+ * @param fname 
+ */
+void newfs_set_dentry_name(struct newfs_dentry* dentry, const char* fname) {
+    newfs_name_free(dentry->fname, dentry->name_len);
+    dentry->name_len = strlen(fname);
+    dentry->fname    = newfs_name_alloc(fname, dentry->name_len);
+    dentry->hash     = newfs_hash_name(dentry->fname);
+}
+
+/**
+ * @brief 释放目录项及其名字
+ * 
+ * @param dentry 
+ */
+void newfs_free_dentry(struct newfs_dentry* dentry) {
+    newfs_name_free(dentry->fname, dentry->name_len);
+    newfs_slab_free(&newfs_super.dentry_slab, dentry);
+}
+
+/**
+ * @brief 为一个inode分配dentry，采用头插法
+ * 新建、改名进来的名字都走这里，顺带作废该名字不存在的记录并记入Bloom过滤器。
+ * 新建的dentry放进newfs_reserve_dentry已留好空间的目录块：
+ * 带索引的目录放进其键所在的叶子块，线性目录放进第一个放得下的块，该块变脏
+ * @param inode 
+ * @param dentry 
+ * @return int 目录项数，读索引块失败时返回负的错误码，dentry没有挂进目录
+ */
+int newfs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    //只需要修改父目录inode中的指针指向新增的dentry结构，
+    //新增的dentry的兄弟指针指向原来第一个子文件dentry即可。
+    struct newfs_dx_key key;
+    int    blk;
+    key.hash = dentry->hash;
+    key.name = dentry->fname;
+    key.len  = dentry->name_len;
+    newfs_neg_drop(inode, key.name, key.len, key.hash);
+    if (inode->bloom != NULL) {
+        newfs_bloom_add(inode, key.hash);
+    }
+    if (NEWFS_IS_INDEXED(inode)) {
+        blk = newfs_dx_leaf(inode, &key, NULL, NULL, NULL);
+        if (blk < 0) {
+            NEWFS_DBG("[%s] io error\n", __func__);
+            return -NEWFS_ERROR_IO;
+        }
+        dentry->dblk = blk;
+    }
+    else if (inode->dblks != NULL) {                   /* 内联目录的记录都在inode槽里，不分块 */
+        dentry->dblk = newfs_dir_find_blk(inode, NEWFS_DENTRY_SZ(dentry->name_len));
     }
+    if (dentry->dblk >= 0) {
+        inode->dblks[dentry->dblk].dirty = TRUE;
+    }
+    newfs_dir_link(inode, dentry);
     inode->dir_cnt++;
+    if (dentry->inode != NULL) {
+        newfs_lru_pin(inode);
+    }
     return inode->dir_cnt;
 }
 
+/**
+ * @brief 把dentry从目录中摘下但不释放，改名时再挂到新目录；所在目录块变脏，回写时块内其后的记录前移补上空洞
+ * 
+ * @param inode 父目录inode
+ * @param dentry 
+ * @return int 
+ */
+int newfs_detach_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    struct newfs_dentry* dentry_cursor = inode->dentrys;
+    struct newfs_dentry** bucket;
+
+    if (dentry_cursor == dentry) {
+        inode->dentrys = dentry->brother;
+    }
+    else {
+        while (dentry_cursor != NULL && dentry_cursor->brother != dentry) {
+            dentry_cursor = dentry_cursor->brother;
+        }
+        if (dentry_cursor == NULL) {
+            return -NEWFS_ERROR_NOTFOUND;
+        }
+        dentry_cursor->brother = dentry->brother;
+    }
+    bucket = &inode->dhash[dentry->hash & (inode->dhash_sz - 1)];
+    while (*bucket != dentry) {
+        bucket = &(*bucket)->hash_next;
+    }
+    *bucket = dentry->hash_next;
+    inode->dhash_cnt--;
+    if (dentry->dblk >= 0) {
+        newfs_dir_unchain(inode, dentry);
+    }
+    dentry->dblk = -1;
+    inode->dir_cnt--;
+    if (dentry->inode != NULL) {
+        newfs_lru_unpin(inode, FALSE);
+    }
+    newfs_mark_inode_dirty(inode, NEWFS_FLAG_DIRTY);
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 从目录中删去一个dentry并释放它
+ * 
+ * @param inode 父目录inode
+ * @param dentry 
+ * @return int 
+ */
+int newfs_drop_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    int ret = newfs_detach_dentry(inode, dentry);
+    if (ret == NEWFS_ERROR_NONE) {
+        newfs_free_dentry(dentry);
+    }
+    return ret;
+}
+
+/**
+ * @brief 为即将加入目录的fname预留空间
+ * 全部目录项仍装得进inode槽时目录保持内联，不分配数据块，装不下时全部搬进第0块；
+ * 线性目录找一个放得下的块，都放不下时转为带索引的目录；
+ * 带索引的目录找到该名字所在的叶子块，放不下就分裂，直到放得下
+ * @param inode 父目录inode
+ * @param fname 新目录项的文件名
+ * @return int 
+ */
+int newfs_reserve_dentry(struct newfs_inode* inode, const char* fname) {
+    struct newfs_dentry* dentry_cursor;
+    struct newfs_dx_key  key;
+    int path[NEWFS_DX_MAX_LEVELS + 2], idx[NEWFS_DX_MAX_LEVELS + 2];
+    int sz = NEWFS_DENTRY_SZ(strlen(fname));
+    int depth, b, ret;
+
+    if (NEWFS_IS_INLINE_DIR(inode)) {
+        if (newfs_dir_inline_sz(inode) + sz <= NEWFS_INLINE_SZ) {
+            return NEWFS_ERROR_NONE;
+        }
+        ret = newfs_dir_grow(inode, 1);                /* 内联区不超过一块，全部放进第0块 */
+        if (ret < 0) {
+            return ret;
+        }
+        for (dentry_cursor = inode->dentrys; dentry_cursor != NULL; dentry_cursor = dentry_cursor->brother) {
+            newfs_dir_chain(inode, dentry_cursor, 0);
+        }
+        return NEWFS_ERROR_NONE;
+    }
+
+    if (!NEWFS_IS_INDEXED(inode)) {
+        if (newfs_dir_find_blk(inode, sz) >= 0) {
+            return NEWFS_ERROR_NONE;
+        }
+        ret = newfs_dx_convert(inode);
+        if (ret != NEWFS_ERROR_NONE) {
+            return ret;
+        }
+    }
+
+    newfs_dx_make_key(fname, &key);
+    while (TRUE) {
+        b = newfs_dx_leaf(inode, &key, path, idx, &depth);
+        if (b < 0 || newfs_dir_load_blk(inode, b, FALSE) != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_IO;
+        }
+        if (inode->dblks[b].used + sz <= NEWFS_BLK_SZ()) {
+            return NEWFS_ERROR_NONE;
+        }
+        ret = newfs_dx_split_leaf(inode, b, path, idx, depth);
+        if (ret != NEWFS_ERROR_NONE) {
+            return ret;
+        }
+    }
+}
 
 /**
  * @brief 获取文件名
@@ -631,8 +3080,13 @@ char* newfs_get_fname(const char* path) {
  * @return struct newfs_dentry* 
  */
 struct newfs_dentry* newfs_get_dentry(struct newfs_inode * inode, int dir) {
-    struct newfs_dentry* dentry_cursor = inode->dentrys;
+    struct newfs_dentry* dentry_cursor;
     int    cnt = 0;
+    if (NEWFS_IS_INDEXED(inode) && newfs_dx_load_all(inode, 0, NULL) != NEWFS_ERROR_NONE) {
+        NEWFS_DBG("[%s] io error\n", __func__);
+        return NULL;
+    }
+    dentry_cursor = inode->dentrys;
     while (dentry_cursor)
     {
         if (dir == cnt) {
@@ -646,51 +3100,158 @@ struct newfs_dentry* newfs_get_dentry(struct newfs_inode * inode, int dir) {
 
 
 /**
- * @brief 分配一个inode，占用位图
- * 为目录项创建inode节点
- * @param dentry 该dentry指向分配的inode
- * @return newfs_inode
+ * @brief 将文件第blk个逻辑块映射到数据区块号
+ * 从上次命中的extent开始向后找，顺序读写时每次都是O(1)
+ * @param inode 
+ * @param blk 逻辑块号
+ * @param run 可为NULL，返回从该块起在同一extent内物理连续的块数
+ * @return int 数据区块号，未分配返回-1
  */
-struct newfs_inode* newfs_alloc_data(struct newfs_dentry * dentry) {
-    struct newfs_inode* inode;
-    int byte_cursor = 0;    //字节游标，用于遍历位图的字节
-    int bit_cursor  = 0;    //位游标，用于遍历位图的位
-    int ino_cursor  = 0;    //inode游标，表示当前处理的inode块号
-    int dat_cursor  = 0;    //data游标，表示当前处理的data块号
+int newfs_bmap(struct newfs_inode * inode, int blk, int * run) {
+    struct newfs_extent* extent;
+    int i, lblk;
 
-    boolean is_find_free_entry = FALSE; //是否找到未使用的inode节点
-
-    //​ ①在data位图上寻找未使用的data节点。
-    for (byte_cursor = 0; byte_cursor < NEWFS_BLKS_SZ(newfs_super.map_data_blks); 
-         byte_cursor++)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            if((newfs_super.map_data[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                /* 当前dat_cursor位置空闲 */
-                newfs_super.map_data[byte_cursor] |= (0x1 << bit_cursor);
-                is_find_free_entry = TRUE;           
-                break;
+    if (blk < 0 || blk >= inode->blk_cnt || newfs_load_extents(inode) != NEWFS_ERROR_NONE) {
+        return -1;
+    }
+    i    = inode->ext_cursor;
+    lblk = inode->ext_cursor_blk;
+    if (blk < lblk) {
+        i    = 0;
+        lblk = 0;
+    }
+    for (; i < inode->extent_cnt; i++) {
+        extent = newfs_extent_at(inode, i);
+        if (blk < lblk + extent->len) {
+            inode->ext_cursor     = i;
+            inode->ext_cursor_blk = lblk;
+            if (run != NULL) {
+                *run = lblk + extent->len - blk;
             }
-            dat_cursor++;
+            return extent->start + blk - lblk;
         }
-        if (is_find_free_entry) {
-            break;
+        lblk += extent->len;
+    }
+    return -1;
+}
+
+/**
+ * @brief 为inode分配数据块，使其至少拥有blk_cnt个块
+ * 优先原地延长最后一个extent，延长不了再按剩余块数分配一段新的连续块；
+ * 找不到这么长的连续空间时逐次减半，由多个extent拼起来。
+ * 新的块从最后一个extent之后（空文件则从inode所在块组）开始找。
+ * 直接extent用完后依次放进一级、二级间接块
+ * 内联的小文件第一次分配时先把数据转到第0页，随后按普通块写回
+ * @param inode 
+ * @param blk_cnt 需要的总块数
+ * @return int 
+ */
+int newfs_alloc_data(struct newfs_inode * inode, int blk_cnt) {
+    struct newfs_extent* extent;
+    int need, start, ret;
+
+    if (inode->blk_cnt >= blk_cnt) {
+        return NEWFS_ERROR_NONE;
+    }
+    if (newfs_load_extents(inode) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+    /* 内联文件转为块存储：先把数据读进第0页并置脏，分配后按普通块写回 */
+    if (NEWFS_IS_INLINE(inode) && inode->size > 0) {
+        if (newfs_get_page(inode, 0, inode->size, FALSE) == NULL) {
+            return -NEWFS_ERROR_IO;
         }
+        inode->pages[0].flag |= NEWFS_PAGE_DIRTY;
+        newfs_mark_inode_dirty(inode, NEWFS_FLAG_DATA_DIRTY);
     }
+    /* 中途失败时已分配的块仍归该文件，同样需要落盘 */
+    newfs_mark_inode_dirty(inode, NEWFS_FLAG_DIRTY);
+
+    while (inode->blk_cnt < blk_cnt) {
+        need   = blk_cnt - inode->blk_cnt;
+        extent = inode->extent_cnt > 0 ? newfs_extent_at(inode, inode->extent_cnt - 1) : NULL;
+
+        /* 紧跟最后一个extent的块空闲则直接接上 */
+        if (extent != NULL && !newfs_bitmap_test(&newfs_super.bmap_data, extent->start + extent->len)) {
+            newfs_bitmap_set(&newfs_super.bmap_data, extent->start + extent->len, 1);
+            newfs_super.map_data_dirty[NEWFS_GROUP_OF(extent->start)] = TRUE;
+            extent->len++;
+            inode->blk_cnt++;
+            inode->ext_dirty = inode->ext_dirty < inode->extent_cnt - 1 ? inode->ext_dirty : inode->extent_cnt - 1;
+            continue;
+        }
 
-    // ②为目录项分配inode节点并建立他们之间的连接。
-    if (!is_find_free_entry || dat_cursor == newfs_super.max_data)
-        return -NEWFS_ERROR_NOSPACE;
+        ret = newfs_extent_reserve(inode);
+        if (ret != NEWFS_ERROR_NONE) {
+            return ret;
+        }
+        start = -1;
+        while (need > 0 && (start = newfs_alloc_blks(newfs_data_goal(inode), need)) < 0) {
+            need /= 2;
+        }
+        if (start < 0) {
+            newfs_extent_unreserve(inode);
+            return -NEWFS_ERROR_NOSPACE;
+        }
+        extent = newfs_extent_at(inode, inode->extent_cnt);
+        extent->start = start;
+        extent->len   = need;
+        inode->ext_dirty = inode->ext_dirty < inode->extent_cnt ? inode->ext_dirty : inode->extent_cnt;
+        inode->extent_cnt++;
+        inode->blk_cnt += need;
+    }
+    return NEWFS_ERROR_NONE;
+}
 
-    // inode data 都有空闲，则分配inode
-    /*inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
-    inode->data  = dat_cursor; 
-    inode->size = 0;*/
+/**
+ * @brief 释放inode：归还它的数据块、extent间接块和inode号，并释放内存中的inode，不动父目录的计数
+ * 新建时目录项没能挂进父目录，用它撤销刚分配的inode
+ * @param inode 
+ * @return int 
+ */
+int newfs_free_inode(struct newfs_inode * inode) {
+    struct newfs_extent* extent;
+    int per = NEWFS_EXTENTS_PER_BLK();
+    int i, k, blks;
 
+    if (newfs_load_extents(inode) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+    for (i = 0; i < inode->extent_cnt; i++) {
+        extent = newfs_extent_at(inode, i);
+        newfs_free_blks(extent->start, extent->len);
+    }
+    blks = inode->extent_cnt > NEWFS_EXTENT_CNT ? (inode->extent_cnt - NEWFS_EXTENT_CNT + per - 1) / per : 0;
+    for (k = 0; k < blks; k++) {
+        newfs_free_blks(newfs_extent_blk(inode, k), 1);
+    }
+    if (inode->block_pointer[NEWFS_DIND] >= 0) {
+        newfs_free_blks(inode->block_pointer[NEWFS_DIND], 1);
+    }
+    newfs_bitmap_clear(&newfs_super.bmap_inode, inode->ino, 1);
+    newfs_super.map_inode_dirty[NEWFS_GROUP_OF(inode->ino)] = TRUE;
 
-    if (NEWFS_IS_REG(inode)) {
-        inode->data = (uint8_t *)malloc(NEWFS_BLKS_SZ(NEWFS_DATA_PER_FILE));
+    if (inode->flag != 0) {                            /* 不再回写 */
+        newfs_clear_inode_dirty(inode);
     }
+    newfs_lru_del(inode);
+    newfs_release_inode(inode);
+    newfs_slab_free(&newfs_super.inode_slab, inode);
+    return NEWFS_ERROR_NONE;
+}
 
-    return inode;
-}
\ No newline at end of file
+/**
+ * @brief 删除已挂在目录中的inode，见newfs_free_inode
+ * 调用者保证目录已为空
+ * @param inode 
+ * @return int 
+ */
+int newfs_drop_inode(struct newfs_inode * inode) {
+    struct newfs_dentry* dentry = inode->dentry;
+    int ret = newfs_free_inode(inode);
+    if (ret == NEWFS_ERROR_NONE) {                     /* 目录项随后摘下时不再计入父目录 */
+        dentry->inode = NULL;
+        newfs_lru_unpin(dentry->parent->inode, FALSE);
+    }
+    return ret;
+}
@@ -22,7 +22,7 @@
 * SECTION: sfs_utils.c
 *******************************************************************************/
 char* 			   sfs_get_fname(const char* path);
-int 			   sfs_calc_lvl(const char * path);
+boolean 		   sfs_path_next(struct sfs_path_iter * it);
 int 			   sfs_driver_read(int offset, uint8_t *out_content, int size);
 int 			   sfs_driver_write(int offset, uint8_t *in_content, int size);
 
@@ -30,8 +30,12 @@ int 			   sfs_driver_write(int offset, uint8_t *in_content, int size);
 int 			   sfs_mount(struct custom_options options);
 int 			   sfs_umount();
 
+struct sfs_dentry* new_dentry(char * fname, SFS_FILE_TYPE ftype);
+void 			   sfs_free_dentry(struct sfs_dentry* dentry);
 int 			   sfs_alloc_dentry(struct sfs_inode * inode, struct sfs_dentry * dentry);
 int 			   sfs_drop_dentry(struct sfs_inode * inode, struct sfs_dentry * dentry);
+struct sfs_dentry* sfs_find_dentry(struct sfs_inode * inode, const char * fname);
+struct sfs_dentry* sfs_find_name(struct sfs_inode * inode, const char * name, int len, uint32_t hash);
 struct sfs_inode*  sfs_alloc_inode(struct sfs_dentry * dentry);
 int 			   sfs_sync_inode(struct sfs_inode * inode);
 int 			   sfs_drop_inode(struct sfs_inode * inode);
@@ -36,6 +36,7 @@ typedef enum sfs_file_type {
 #define SFS_ERROR_UNSUPPORTED   ENXIO
 #define SFS_ERROR_IO            EIO     /* Error Input/Output */
 #define SFS_ERROR_INVAL         EINVAL  /* Invalid Args */
+#define SFS_ERROR_NAMETOOLONG   ENAMETOOLONG
 
 #define SFS_MAX_FILE_NAME       128
 #define SFS_INODE_PER_FILE      1
@@ -58,8 +59,9 @@ typedef enum sfs_file_type {
 #define SFS_ROUND_UP(value, round)      (value % round == 0 ? value : (value / round + 1) * round)
 
 #define SFS_BLKS_SZ(blks)               (blks * SFS_IO_SZ())
-#define SFS_ASSIGN_FNAME(psfs_dentry, _fname)\ 
-                                        memcpy(psfs_dentry->fname, _fname, strlen(_fname))
+#define SFS_NAME_CHUNK_SZ               (16 * 1024)           /* 文件名区每次申请的大小 */
+#define SFS_NAME_CLASSES                (SFS_MAX_FILE_NAME / 8)
+#define SFS_NAME_CLASS(len)             ((len) / 8)           /* 名字连同'\0'按8字节一档 */
 #define SFS_INO_OFS(ino)                (sfs_super.data_offset + ino * SFS_BLKS_SZ((\
                                         SFS_INODE_PER_FILE + SFS_DATA_PER_FILE)))
 #define SFS_DATA_OFS(ino)               (SFS_INO_OFS(ino) + SFS_BLKS_SZ(SFS_INODE_PER_FILE))
@@ -87,17 +89,31 @@ struct sfs_inode
     int                dir_cnt;
     struct sfs_dentry* dentry;                        /* 指向该inode的dentry */
     struct sfs_dentry* dentrys;                       /* 所有目录项 */
+    struct sfs_dentry** dhash;                        /* 目录项按文件名散列的桶，链在hash_next上 */
+    int                dhash_sz;                      /* 桶数，2的幂，目录项多于桶数时翻倍 */
     uint8_t*           data;           
 };  
 
 struct sfs_dentry
 {
-    char               fname[SFS_MAX_FILE_NAME];
-    struct sfs_dentry* parent;                        /* 父亲Inode的dentry */
-    struct sfs_dentry* brother;                       /* 兄弟 */
+    /* 查找时要碰的字段放在最前，落在同一个缓存行 */
+    uint32_t           hash;                          /* 文件名散列，创建时算好 */
+    int                name_len;
+    struct sfs_dentry* hash_next;                     /* 同一散列桶中的下一个 */
+    char*              fname;                         /* 存在文件名区，以'\0'结尾 */
     int                ino;
-    struct sfs_inode*  inode;                         /* 指向inode */
     SFS_FILE_TYPE      ftype;
+    struct sfs_inode*  inode;                         /* 指向inode */
+    struct sfs_dentry* brother;                       /* 兄弟 */
+    struct sfs_dentry* parent;                        /* 父亲Inode的dentry */
+};
+
+struct sfs_path_iter                                  /* 路径分量迭代器，不复制也不改动路径，可重入 */
+{
+    const char*        pos;                           /* 下一个分量从这里开始找 */
+    const char*        name;                          /* 当前分量，不以'\0'结尾 */
+    int                len;
+    uint32_t           hash;
 };
 
 struct sfs_super
@@ -118,18 +134,11 @@ struct sfs_super
     boolean            is_mounted;
 
     struct sfs_dentry* root_dentry;
-};
 
-static inline struct sfs_dentry* new_dentry(char * fname, SFS_FILE_TYPE ftype) {
-    struct sfs_dentry * dentry = (struct sfs_dentry *)malloc(sizeof(struct sfs_dentry));
-    memset(dentry, 0, sizeof(struct sfs_dentry));
-    SFS_ASSIGN_FNAME(dentry, fname);
-    dentry->ftype   = ftype;
-    dentry->ino     = -1;
-    dentry->inode   = NULL;
-    dentry->parent  = NULL;
-    dentry->brother = NULL;                                            
-}
+    uint8_t*           name_chunk;                    /* 文件名区当前块，块首存上一块的指针 */
+    int                name_used;
+    char*              name_free[SFS_NAME_CLASSES];   /* 各档归还的名字，开头存下一个的指针 */
+};
 /******************************************************************************
 * SECTION: FS Specific Structure - Disk structure
 *******************************************************************************/
@@ -83,6 +83,9 @@ int sfs_mkdir(const char* path, mode_t mode) {
 	}
 
 	fname  = sfs_get_fname(path);
+	if (strlen(fname) >= SFS_MAX_FILE_NAME) {
+		return -SFS_ERROR_NAMETOOLONG;
+	}
 	dentry = new_dentry(fname, SFS_DIR); 
 	dentry->parent = last_dentry;
 	inode  = sfs_alloc_inode(dentry);
@@ -188,6 +191,9 @@ int sfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	}
 
 	fname = sfs_get_fname(path);
+	if (strlen(fname) >= SFS_MAX_FILE_NAME) {
+		return -SFS_ERROR_NAMETOOLONG;
+	}
 	
 	if (S_ISREG(mode)) {
 		dentry = new_dentry(fname, SFS_REG_FILE);
@@ -234,6 +240,14 @@ int sfs_write(const char* path, const char* buf, size_t size, off_t offset,
 		return -SFS_ERROR_SEEK;
 	}
 
+	if (offset + size > SFS_BLKS_SZ(SFS_DATA_PER_FILE)) {
+		return -SFS_ERROR_NOSPACE;
+	}
+
+	if (offset + size > inode->size) {				  /* 缓冲区随文件增长 */
+		inode->data = (uint8_t *)realloc(inode->data, offset + size);
+	}
+
 	memcpy(inode->data + offset, buf, size);
 	inode->size = offset + size > inode->size ? offset + size : inode->size;
 	
@@ -269,6 +283,10 @@ int sfs_read(const char* path, char* buf, size_t size, off_t offset,
 		return -SFS_ERROR_SEEK;
 	}
 
+	if (offset + size > inode->size) {
+		size = inode->size - offset;
+	}
+
 	memcpy(buf, inode->data + offset, size);
 
 	return size;			   
@@ -292,6 +310,7 @@ int sfs_unlink(const char* path) {
 
 	sfs_drop_inode(inode);
 	sfs_drop_dentry(dentry->parent->inode, dentry);
+	sfs_free_dentry(dentry);
 	return SFS_ERROR_NONE;
 }
 /**
@@ -490,6 +509,15 @@ int sfs_truncate(const char* path, off_t offset) {
 		return -SFS_ERROR_ISDIR;
 	}
 
+	if (offset > SFS_BLKS_SZ(SFS_DATA_PER_FILE)) {
+		return -SFS_ERROR_NOSPACE;
+	}
+
+	if (offset > inode->size) {						  /* 扩展部分补零 */
+		inode->data = (uint8_t *)realloc(inode->data, offset);
+		memset(inode->data + inode->size, 0, offset - inode->size);
+	}
+
 	inode->size = offset;
 
 	return SFS_ERROR_NONE;
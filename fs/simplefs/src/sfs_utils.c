@@ -15,27 +15,33 @@ char* sfs_get_fname(const char* path) {
     return q;
 }
 /**
- * @brief 计算路径的层级
- * exm: /av/c/d/f
- * -> lvl = 4
- * @param path 
- * @return int 
+ * @brief 从路径中取出下一个分量，跳过多余的'/'，顺带算出分量的散列
+ * 只移动it中的指针，不分配内存也不改动路径，可重入
+ * @param it pos先指向路径开头
+ * @return boolean 没有分量了返回FALSE
  */
-int sfs_calc_lvl(const char * path) {
-    // char* path_cpy = (char *)malloc(strlen(path));
-    // strcpy(path_cpy, path);
-    char* str = path;
-    int   lvl = 0;
-    if (strcmp(path, "/") == 0) {
-        return lvl;
-    }
-    while (*str != NULL) {
-        if (*str == '/') {
-            lvl++;
-        }
-        str++;
+boolean sfs_path_next(struct sfs_path_iter* it) {
+    const char* pos = it->pos;
+    uint32_t    h   = 2166136261u;
+
+    while (*pos == '/') {
+        pos++;
+    }
+    if (*pos == '\0') {
+        it->pos = pos;
+        return FALSE;
     }
-    return lvl;
+    it->name = pos;
+    while (*pos != '/' && *pos != '\0') {
+        h = (h ^ (uint8_t)*pos++) * 16777619u;
+    }
+    it->len  = pos - it->name;
+    it->hash = h;
+    while (*pos == '/') {
+        pos++;
+    }
+    it->pos = pos;
+    return TRUE;
 }
 /**
  * @brief 驱动读
@@ -94,6 +100,157 @@ int sfs_driver_write(int offset, uint8_t *in_content, int size) {
     free(temp_content);
     return SFS_ERROR_NONE;
 }
+/**
+ * @brief 文件名散列，FNV-1a
+ * 
+ * @param fname 
+ * @return uint32_t 
+ */
+static uint32_t sfs_hash_name(const char* fname) {
+    uint32_t hash = 2166136261u;
+    while (*fname) {
+        hash = (hash ^ (uint8_t)*fname++) * 16777619u;
+    }
+    return hash;
+}
+/**
+ * @brief 把dentry挂进目录的散列表，目录项多于桶数时桶数翻倍并重新散列
+ * 
+ * @param inode 
+ * @param dentry 
+ */
+static void sfs_hash_insert(struct sfs_inode* inode, struct sfs_dentry* dentry) {
+    struct sfs_dentry** buckets;
+    struct sfs_dentry*  cursor;
+    struct sfs_dentry*  next;
+    int sz, i;
+
+    if (inode->dir_cnt >= inode->dhash_sz) {
+        sz      = inode->dhash_sz == 0 ? 8 : inode->dhash_sz * 2;
+        buckets = (struct sfs_dentry **)calloc(sz, sizeof(struct sfs_dentry *));
+        for (i = 0; i < inode->dhash_sz; i++) {
+            for (cursor = inode->dhash[i]; cursor != NULL; cursor = next) {
+                next = cursor->hash_next;
+                cursor->hash_next = buckets[cursor->hash & (sz - 1)];
+                buckets[cursor->hash & (sz - 1)] = cursor;
+            }
+        }
+        free(inode->dhash);
+        inode->dhash    = buckets;
+        inode->dhash_sz = sz;
+    }
+    i = dentry->hash & (inode->dhash_sz - 1);
+    dentry->hash_next = inode->dhash[i];
+    inode->dhash[i]   = dentry;
+}
+/**
+ * @brief 在目录中按名字查找dentry，平均O(1)，名字不必以'\0'结尾
+ * 桶内先比较散列和长度，都相同时才比较名字
+ * @param inode 
+ * @param name 
+ * @param len 
+ * @param hash name的散列
+ * @return struct sfs_dentry* 找不到返回NULL
+ */
+struct sfs_dentry* sfs_find_name(struct sfs_inode* inode, const char* name, int len, uint32_t hash) {
+    struct sfs_dentry* dentry_cursor;
+    if (inode->dhash_sz == 0) {
+        return NULL;
+    }
+    dentry_cursor = inode->dhash[hash & (inode->dhash_sz - 1)];
+    while (dentry_cursor && (dentry_cursor->hash != hash || dentry_cursor->name_len != len || 
+                             memcmp(dentry_cursor->fname, name, len) != 0)) {
+        dentry_cursor = dentry_cursor->hash_next;
+    }
+    return dentry_cursor;
+}
+/**
+ * @brief 在目录中按文件名查找dentry
+ * 
+ * @param inode 
+ * @param fname 
+ * @return struct sfs_dentry* 找不到返回NULL
+ */
+struct sfs_dentry* sfs_find_dentry(struct sfs_inode* inode, const char* fname) {
+    return sfs_find_name(inode, fname, strlen(fname), sfs_hash_name(fname));
+}
+/**
+ * @brief 在文件名区中存一份名字，dentry只留指针
+ * 名字连同'\0'按8字节一档，先取该档归还的名字，没有再在块内依次切出
+ * @param name 
+ * @param len 小于 SFS_MAX_FILE_NAME
+ * @return char* 以'\0'结尾的副本
+ */
+static char* sfs_name_alloc(const char* name, int len) {
+    int      sz = (SFS_NAME_CLASS(len) + 1) * 8;
+    uint8_t* chunk;
+    char*    str;
+    if (sfs_super.name_free[SFS_NAME_CLASS(len)] != NULL) {
+        str = sfs_super.name_free[SFS_NAME_CLASS(len)];
+        sfs_super.name_free[SFS_NAME_CLASS(len)] = *(char **)str;
+    }
+    else {
+        if (sfs_super.name_chunk == NULL || sfs_super.name_used + sz > SFS_NAME_CHUNK_SZ) {
+            chunk = (uint8_t *)malloc(SFS_NAME_CHUNK_SZ);
+            *(uint8_t **)chunk   = sfs_super.name_chunk;
+            sfs_super.name_chunk = chunk;
+            sfs_super.name_used  = sizeof(uint8_t *);
+        }
+        str = (char *)(sfs_super.name_chunk + sfs_super.name_used);
+        sfs_super.name_used += sz;
+    }
+    memcpy(str, name, len);
+    str[len] = '\0';
+    return str;
+}
+/**
+ * @brief 归还名字，挂到所在档的空闲链表上，len须与分配时一致
+ * 
+ * @param name 
+ * @param len 
+ */
+static void sfs_name_free(char* name, int len) {
+    *(char **)name = sfs_super.name_free[SFS_NAME_CLASS(len)];
+    sfs_super.name_free[SFS_NAME_CLASS(len)] = name;
+}
+/**
+ * @brief 释放整个文件名区
+ */
+static void sfs_name_destroy() {
+    uint8_t* chunk;
+    while (sfs_super.name_chunk != NULL) {
+        chunk = sfs_super.name_chunk;
+        sfs_super.name_chunk = *(uint8_t **)chunk;
+        free(chunk);
+    }
+    memset(sfs_super.name_free, 0, sizeof(sfs_super.name_free));
+}
+/**
+ * @brief 创建dentry，名字存进文件名区，长度和散列一并算好
+ * 
+ * @param fname 
+ * @param ftype 
+ * @return struct sfs_dentry* 
+ */
+struct sfs_dentry* new_dentry(char * fname, SFS_FILE_TYPE ftype) {
+    struct sfs_dentry * dentry = (struct sfs_dentry *)malloc(sizeof(struct sfs_dentry));
+    memset(dentry, 0, sizeof(struct sfs_dentry));
+    dentry->name_len = strlen(fname);
+    dentry->fname    = sfs_name_alloc(fname, dentry->name_len);
+    dentry->hash     = sfs_hash_name(dentry->fname);
+    dentry->ftype    = ftype;
+    dentry->ino      = -1;
+    return dentry;
+}
+/**
+ * @brief 释放dentry及其名字
+ * 
+ * @param dentry 
+ */
+void sfs_free_dentry(struct sfs_dentry* dentry) {
+    sfs_name_free(dentry->fname, dentry->name_len);
+    free(dentry);
+}
 /**
  * @brief 为一个inode分配dentry，采用头插法
  * 
@@ -102,6 +259,7 @@ int sfs_driver_write(int offset, uint8_t *in_content, int size) {
  * @return int 
  */
 int sfs_alloc_dentry(struct sfs_inode* inode, struct sfs_dentry* dentry) {
+    sfs_hash_insert(inode, dentry);
     if (inode->dentrys == NULL) {
         inode->dentrys = dentry;
     }
@@ -121,6 +279,7 @@ int sfs_alloc_dentry(struct sfs_inode* inode, struct sfs_dentry* dentry) {
  */
 int sfs_drop_dentry(struct sfs_inode * inode, struct sfs_dentry * dentry) {
     boolean is_find = FALSE;
+    struct sfs_dentry** bucket;
     struct sfs_dentry* dentry_cursor;
     dentry_cursor = inode->dentrys;
     
@@ -142,6 +301,11 @@ int sfs_drop_dentry(struct sfs_inode * inode, struct sfs_dentry * dentry) {
     if (!is_find) {
         return -SFS_ERROR_NOTFOUND;
     }
+    bucket = &inode->dhash[dentry->hash & (inode->dhash_sz - 1)];
+    while (*bucket != dentry) {
+        bucket = &(*bucket)->hash_next;
+    }
+    *bucket = dentry->hash_next;
     inode->dir_cnt--;
     return inode->dir_cnt;
 }
@@ -189,10 +353,9 @@ struct sfs_inode* sfs_alloc_inode(struct sfs_dentry * dentry) {
     
     inode->dir_cnt = 0;
     inode->dentrys = NULL;
-    
-    if (SFS_IS_REG(inode)) {
-        inode->data = (uint8_t *)malloc(SFS_BLKS_SZ(SFS_DATA_PER_FILE));
-    }
+    inode->dhash   = NULL;
+    inode->dhash_sz = 0;
+    inode->data    = NULL;                            /* 数据缓冲随文件大小增长 */
 
     return inode;
 }
@@ -226,7 +389,8 @@ int sfs_sync_inode(struct sfs_inode * inode) {
         offset        = SFS_DATA_OFS(ino);
         while (dentry_cursor != NULL)
         {
-            memcpy(dentry_d.fname, dentry_cursor->fname, SFS_MAX_FILE_NAME);
+            memset(dentry_d.fname, 0, SFS_MAX_FILE_NAME);
+            memcpy(dentry_d.fname, dentry_cursor->fname, dentry_cursor->name_len);
             dentry_d.ftype = dentry_cursor->ftype;
             dentry_d.ino = dentry_cursor->ino;
             if (sfs_driver_write(offset, (uint8_t *)&dentry_d, 
@@ -243,9 +407,9 @@ int sfs_sync_inode(struct sfs_inode * inode) {
             offset += sizeof(struct sfs_dentry_d);
         }
     }
-    else if (SFS_IS_REG(inode)) {
+    else if (SFS_IS_REG(inode) && inode->size > 0) {
         if (sfs_driver_write(SFS_DATA_OFS(ino), inode->data, 
-                             SFS_BLKS_SZ(SFS_DATA_PER_FILE)) != SFS_ERROR_NONE) {
+                             inode->size) != SFS_ERROR_NONE) {
             SFS_DBG("[%s] io error\n", __func__);
             return -SFS_ERROR_IO;
         }
@@ -304,8 +468,9 @@ int sfs_drop_inode(struct sfs_inode * inode) {
             sfs_drop_dentry(inode, dentry_cursor);
             dentry_to_free = dentry_cursor;
             dentry_cursor = dentry_cursor->brother;
-            free(dentry_to_free);
+            sfs_free_dentry(dentry_to_free);
         }
+        free(inode->dhash);
     }
     else if (SFS_IS_REG(inode) || SFS_IS_SYM_LINK(inode)) {
         for (byte_cursor = 0; byte_cursor < SFS_BLKS_SZ(sfs_super.map_inode_blks); 
@@ -353,6 +518,9 @@ struct sfs_inode* sfs_read_inode(struct sfs_dentry * dentry, int ino) {
     memcpy(inode->target_path, inode_d.target_path, SFS_MAX_FILE_NAME);
     inode->dentry = dentry;
     inode->dentrys = NULL;
+    inode->dhash = NULL;
+    inode->dhash_sz = 0;
+    inode->data = NULL;
     if (SFS_IS_DIR(inode)) {
         dir_cnt = inode_d.dir_cnt;
         for (i = 0; i < dir_cnt; i++)
@@ -369,10 +537,10 @@ struct sfs_inode* sfs_read_inode(struct sfs_dentry * dentry, int ino) {
             sfs_alloc_dentry(inode, sub_dentry);
         }
     }
-    else if (SFS_IS_REG(inode)) {
-        inode->data = (uint8_t *)malloc(SFS_BLKS_SZ(SFS_DATA_PER_FILE));
+    else if (SFS_IS_REG(inode) && inode->size > 0) {   /* 只按文件实际大小分配和读取 */
+        inode->data = (uint8_t *)malloc(inode->size);
         if (sfs_driver_read(SFS_DATA_OFS(ino), (uint8_t *)inode->data, 
-                            SFS_BLKS_SZ(SFS_DATA_PER_FILE)) != SFS_ERROR_NONE) {
+                            inode->size) != SFS_ERROR_NONE) {
             SFS_DBG("[%s] io error\n", __func__);
             return NULL;                    
         }
@@ -401,78 +569,57 @@ struct sfs_dentry* sfs_get_dentry(struct sfs_inode * inode, int dir) {
 }
 /**
  * @brief 
- * path: /qwe/ad  total_lvl = 2,
- *      1) find /'s inode       lvl = 1
+ * path: /qwe/ad
+ *      1) find /'s inode
  *      2) find qwe's dentry 
- *      3) find qwe's inode     lvl = 2
- *      4) find ad's dentry
+ *      3) find qwe's inode
+ *      4) find ad's dentry，ad是最后一级
  *
- * path: /qwe     total_lvl = 1,
- *      1) find /'s inode       lvl = 1
- *      2) find qwe's dentry
+ * path: /qwe
+ *      1) find /'s inode
+ *      2) find qwe's dentry，qwe是最后一级
  * 
+ * 一遍扫描路径，不复制路径
  * @param path 
  * @return struct sfs_inode* 
  */
 struct sfs_dentry* sfs_lookup(const char * path, boolean* is_find, boolean* is_root) {
-    struct sfs_dentry* dentry_cursor = sfs_super.root_dentry;
-    struct sfs_dentry* dentry_ret = NULL;
-    struct sfs_inode*  inode; 
-    int   total_lvl = sfs_calc_lvl(path);
-    int   lvl = 0;
-    boolean is_hit;
-    char* fname = NULL;
-    char* path_cpy = (char*)malloc(sizeof(path));
+    struct sfs_dentry*   dentry_cursor = sfs_super.root_dentry;
+    struct sfs_dentry*   dentry_ret = NULL;
+    struct sfs_inode*    inode; 
+    struct sfs_path_iter it;
+    *is_find = FALSE;
     *is_root = FALSE;
-    strcpy(path_cpy, path);
 
-    if (total_lvl == 0) {                           /* 根目录 */
+    it.pos = path;
+    if (!sfs_path_next(&it)) {                      /* 根目录 */
         *is_find = TRUE;
         *is_root = TRUE;
         dentry_ret = sfs_super.root_dentry;
     }
-    fname = strtok(path_cpy, "/");       
-    while (fname)
+    while (dentry_ret == NULL)
     {   
-        lvl++;
         if (dentry_cursor->inode == NULL) {           /* Cache机制 */
-            sfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            dentry_cursor->inode = sfs_read_inode(dentry_cursor, dentry_cursor->ino);
         }
 
         inode = dentry_cursor->inode;
 
-        if (SFS_IS_REG(inode) && lvl < total_lvl) {
+        if (!SFS_IS_DIR(inode)) {
             SFS_DBG("[%s] not a dir\n", __func__);
             dentry_ret = inode->dentry;
             break;
         }
-        if (SFS_IS_DIR(inode)) {
-            dentry_cursor = inode->dentrys;
-            is_hit        = FALSE;
-
-            while (dentry_cursor)
-            {
-                if (memcmp(dentry_cursor->fname, fname, strlen(fname)) == 0) {
-                    is_hit = TRUE;
-                    break;
-                }
-                dentry_cursor = dentry_cursor->brother;
-            }
-            
-            if (!is_hit) {
-                *is_find = FALSE;
-                SFS_DBG("[%s] not found %s\n", __func__, fname);
-                dentry_ret = inode->dentry;
-                break;
-            }
-
-            if (is_hit && lvl == total_lvl) {
-                *is_find = TRUE;
-                dentry_ret = dentry_cursor;
-                break;
-            }
+        dentry_cursor = sfs_find_name(inode, it.name, it.len, it.hash);
+        if (dentry_cursor == NULL) {
+            SFS_DBG("[%s] not found %.*s\n", __func__, it.len, it.name);
+            dentry_ret = inode->dentry;
+            break;
+        }
+        if (!sfs_path_next(&it)) {
+            *is_find = TRUE;
+            dentry_ret = dentry_cursor;
         }
-        fname = strtok(NULL, "/"); 
     }
 
     if (dentry_ret->inode == NULL) {
@@ -600,6 +747,7 @@ int sfs_umount() {
     }
 
     free(sfs_super.map_inode);
+    sfs_name_destroy();
     ddriver_close(SFS_DRIVER());
 
     return SFS_ERROR_NONE;